@@ -0,0 +1,228 @@
+
+#include <ql/qldefines.hpp>
+#ifdef BOOST_MSVC
+#  include <ql/auto_link.hpp>
+#endif
+#include "mceuropeanengine.hpp"
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/instruments/payoffs.hpp>
+#include <ql/exercise.hpp>
+#include <ql/termstructures/yield/zerocurve.hpp>
+#include <ql/termstructures/volatility/equityfx/blackvariancecurve.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace QuantLib;
+
+/* Convergence and throughput benchmark for MCEuropeanEngine_2.
+
+   Usage: benchmark [--json] [--repeats n]
+
+   For each combination of random-number policy, simulation mode,
+   number of steps, antithetic variate and number of samples, the
+   option is priced with a fixed number of samples and the fastest
+   of a few runs is reported together with samples per second,
+   nanoseconds per sample, the error estimate and the efficiency
+   error * sqrt(time) (lower is better).  Results are written to
+   standard output as CSV, or as JSON if required.
+*/
+
+namespace {
+
+    struct Mode {
+        std::string name;
+        bool constantParameters, exactTerminalSampling, batchedKernel;
+        Size threads;
+    };
+
+    struct Result {
+        std::string rng, mode;
+        Size steps;
+        bool antithetic;
+        Size samples;
+        Real value, error;
+        double seconds;
+    };
+
+    // with a low-discrepancy generator, the error estimate comes
+    // from randomized replications
+    const Size replications = 16;
+
+    template <class RNG>
+    ext::shared_ptr<PricingEngine> makeEngine(
+                 const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+                 const Mode& mode, Size steps, bool antithetic,
+                 Size samples) {
+        MakeMCEuropeanEngine_2<RNG> engine(process);
+        engine.withSteps(steps)
+            .withSamples(samples)
+            .withSeed(42)
+            .withAntitheticVariate(antithetic)
+            .withConstantParameters(mode.constantParameters)
+            .withExactTerminalSampling(mode.exactTerminalSampling)
+            .withBatchedKernel(mode.batchedKernel)
+            .withThreads(mode.threads);
+        if (!RNG::allowsErrorEstimate)
+            engine.withRandomizedQMC(replications);
+        return engine;
+    }
+
+    template <class RNG>
+    void run(const std::string& rng,
+             VanillaOption& option,
+             const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const std::vector<Mode>& modes,
+             Size repeats,
+             std::vector<Result>& results) {
+        const Size steps[] = { 1, 10, 100 };
+        const Size samples[] = { 1000, 10000, 100000 };
+        for (const Mode& mode : modes) {
+            for (Size n : steps) {
+                // the step count doesn't matter for exact sampling
+                if (mode.exactTerminalSampling && n != 1)
+                    continue;
+                for (bool antithetic : { false, true }) {
+                    for (Size m : samples) {
+                        Result r = { rng, mode.name, n, antithetic, m,
+                                     0.0, 0.0, QL_MAX_REAL };
+                        for (Size k=0; k<repeats; ++k) {
+                            // a new engine forces a recalculation
+                            option.setPricingEngine(
+                                makeEngine<RNG>(process, mode, n,
+                                                antithetic, m));
+                            auto start = std::chrono::steady_clock::now();
+                            r.value = option.NPV();
+                            auto end = std::chrono::steady_clock::now();
+                            r.error = option.errorEstimate();
+                            r.seconds = std::min(r.seconds,
+                                std::chrono::duration<double>(end - start)
+                                    .count());
+                        }
+                        results.push_back(r);
+                    }
+                }
+            }
+        }
+    }
+
+    void writeCsv(const std::vector<Result>& results) {
+        std::cout << "rng,mode,steps,antithetic,samples,value,error,"
+                  << "seconds,samples_per_second,ns_per_sample,efficiency"
+                  << std::endl;
+        for (const Result& r : results) {
+            std::cout << r.rng << ',' << r.mode << ',' << r.steps << ','
+                      << (r.antithetic ? 1 : 0) << ',' << r.samples << ','
+                      << r.value << ',' << r.error << ',' << r.seconds << ','
+                      << r.samples/r.seconds << ','
+                      << 1.0e9*r.seconds/r.samples << ','
+                      << r.error*std::sqrt(r.seconds) << std::endl;
+        }
+    }
+
+    void writeJson(const std::vector<Result>& results) {
+        std::cout << "[" << std::endl;
+        for (Size i=0; i<results.size(); ++i) {
+            const Result& r = results[i];
+            std::cout << "  {\"rng\": \"" << r.rng << "\", "
+                      << "\"mode\": \"" << r.mode << "\", "
+                      << "\"steps\": " << r.steps << ", "
+                      << "\"antithetic\": "
+                      << (r.antithetic ? "true" : "false") << ", "
+                      << "\"samples\": " << r.samples << ", "
+                      << "\"value\": " << r.value << ", "
+                      << "\"error\": " << r.error << ", "
+                      << "\"seconds\": " << r.seconds << ", "
+                      << "\"samples_per_second\": "
+                      << r.samples/r.seconds << ", "
+                      << "\"ns_per_sample\": "
+                      << 1.0e9*r.seconds/r.samples << ", "
+                      << "\"efficiency\": "
+                      << r.error*std::sqrt(r.seconds) << "}"
+                      << (i+1 < results.size() ? "," : "") << std::endl;
+        }
+        std::cout << "]" << std::endl;
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+
+    try {
+
+        bool json = false;
+        Size repeats = 3;
+        for (int i=1; i<argc; ++i) {
+            if (std::strcmp(argv[i], "--json") == 0) {
+                json = true;
+            } else if (std::strcmp(argv[i], "--repeats") == 0 && i+1<argc) {
+                repeats = std::max(std::stoi(argv[++i]), 1);
+            } else {
+                std::cerr << "usage: " << argv[0]
+                          << " [--json] [--repeats n]" << std::endl;
+                return 1;
+            }
+        }
+
+        // same market data as the example in main.cpp
+        Date today = Date(24, February, 2022);
+        Settings::instance().evaluationDate() = today;
+
+        Option::Type type(Option::Put);
+        Real underlying = 36;
+        Real strike = 40;
+        Date maturity(24, May, 2022);
+
+        ext::shared_ptr<Exercise> europeanExercise(new EuropeanExercise(maturity));
+        ext::shared_ptr<StrikedTypePayoff> payoff(new PlainVanillaPayoff(type, strike));
+
+        Handle<Quote> underlyingH(ext::make_shared<SimpleQuote>(underlying));
+
+        DayCounter dayCounter = Actual365Fixed();
+        Handle<YieldTermStructure> riskFreeRate(
+            ext::shared_ptr<YieldTermStructure>(
+                new ZeroCurve({today, today + 6*Months}, {0.01, 0.015}, dayCounter)));
+        Handle<BlackVolTermStructure> volatility(
+            ext::shared_ptr<BlackVolTermStructure>(
+                new BlackVarianceCurve(today, {today+3*Months, today+6*Months}, {0.20, 0.25}, dayCounter)));
+
+        ext::shared_ptr<BlackScholesProcess> bsmProcess(
+                 new BlackScholesProcess(underlyingH, riskFreeRate, volatility));
+
+        VanillaOption europeanOption(payoff, europeanExercise);
+
+        Size threads = std::max(std::thread::hardware_concurrency(), 1u);
+        std::vector<Mode> modes = {
+            { "term-structure", false, false, false, 1 },
+            { "constant", true, false, false, 1 },
+            { "exact", true, true, false, 1 },
+            { "batched", true, false, true, 1 },
+            { "threaded", true, false, true, threads }
+        };
+
+        std::vector<Result> results;
+        run<PseudoRandom>("pseudo-random", europeanOption, bsmProcess,
+                          modes, repeats, results);
+        run<LowDiscrepancy>("sobol-rqmc", europeanOption, bsmProcess,
+                            modes, repeats, results);
+
+        if (json)
+            writeJson(results);
+        else
+            writeCsv(results);
+
+        return 0;
+
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 1;
+    }
+}
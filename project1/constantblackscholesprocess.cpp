@@ -1,3 +1,40 @@
 
 #include "constantblackscholesprocess.hpp"
 
+namespace QuantLib {
+
+    ConstantBlackScholesProcess::ConstantBlackScholesProcess(
+                                                    Real x0,
+                                                    Rate riskFreeRate,
+                                                    Rate dividendYield,
+                                                    Volatility volatility)
+    : x0_(x0), riskFreeRate_(riskFreeRate), dividendYield_(dividendYield),
+      volatility_(volatility) {
+        initialize();
+    }
+
+    ConstantBlackScholesProcess::ConstantBlackScholesProcess(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Time maturity,
+             Real strike) {
+        QL_REQUIRE(maturity > 0.0,
+                   "positive maturity required, " << maturity << " given");
+        x0_ = process->x0();
+        riskFreeRate_ = process->riskFreeRate()->zeroRate(
+                              maturity, Continuous, NoFrequency, true).rate();
+        dividendYield_ = process->dividendYield()->zeroRate(
+                              maturity, Continuous, NoFrequency, true).rate();
+        volatility_ = process->blackVolatility()->blackVol(maturity, strike,
+                                                           true);
+        initialize();
+    }
+
+    void ConstantBlackScholesProcess::initialize() {
+        QL_REQUIRE(x0_ > 0.0, "negative or null underlying given");
+        QL_REQUIRE(volatility_ >= 0.0,
+                   "negative volatility given: " << volatility_);
+        drift_ = riskFreeRate_ - dividendYield_ - 0.5*volatility_*volatility_;
+    }
+
+}
+
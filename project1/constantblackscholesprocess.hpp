@@ -1,13 +1,74 @@
 
+#ifndef constant_black_scholes_process_hpp
+#define constant_black_scholes_process_hpp
+
 #include <ql/stochasticprocess.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
 
 namespace QuantLib {
 
-    class ConstantBlackScholesProcess : public StochasticProcess1D {
+    //! Black-Scholes process with constant parameters
+    /*! The underlying value, risk-free rate, dividend yield and
+        volatility are fixed at construction; all process methods
+        are then evaluated in closed form, without any call to the
+        term structures of the originating process.
+
+        As for GeneralizedBlackScholesProcess, drift and diffusion
+        refer to the logarithm of the underlying.
 
-        // your implementation goes here
-        
+        \ingroup processes
+    */
+    class ConstantBlackScholesProcess : public StochasticProcess1D {
+      public:
+        ConstantBlackScholesProcess(Real x0,
+                                    Rate riskFreeRate,
+                                    Rate dividendYield,
+                                    Volatility volatility);
+        /*! The constant parameters are extracted from the passed
+            process; rates are the continuous zero rates at the
+            given maturity, and the volatility is the Black
+            volatility at the given maturity and strike.
+        */
+        ConstantBlackScholesProcess(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Time maturity,
+             Real strike);
+        //! \name StochasticProcess1D interface
+        //@{
+        Real x0() const override { return x0_; }
+        Real drift(Time, Real) const override { return drift_; }
+        Real diffusion(Time, Real) const override { return volatility_; }
+        Real apply(Real x0, Real dx) const override {
+            return x0 * std::exp(dx);
+        }
+        Real expectation(Time, Real x0, Time dt) const override {
+            return x0 * std::exp((riskFreeRate_ - dividendYield_) * dt);
+        }
+        Real stdDeviation(Time, Real, Time dt) const override {
+            return volatility_ * std::sqrt(dt);
+        }
+        Real variance(Time, Real, Time dt) const override {
+            return volatility_ * volatility_ * dt;
+        }
+        Real evolve(Time, Real x0, Time dt, Real dw) const override {
+            return x0 * std::exp(drift_ * dt + volatility_ * std::sqrt(dt) * dw);
+        }
+        //@}
+        //! \name Inspectors
+        //@{
+        Rate riskFreeRate() const { return riskFreeRate_; }
+        Rate dividendYield() const { return dividendYield_; }
+        Volatility volatility() const { return volatility_; }
+        //@}
+      private:
+        void initialize();
+        Real x0_;
+        Rate riskFreeRate_, dividendYield_;
+        Volatility volatility_;
+        Real drift_;
     };
 
 }
 
+
+#endif
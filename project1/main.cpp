@@ -5,6 +5,7 @@
 #endif
 #include "constantblackscholesprocess.hpp"
 #include "mceuropeanengine.hpp"
+#include "mceuropeanportfolio.hpp"
 #include <ql/instruments/vanillaoption.hpp>
 #include <ql/instruments/payoffs.hpp>
 #include <ql/exercise.hpp>
@@ -15,9 +16,38 @@
 #include <ql/utilities/dataformatters.hpp>
 #include <iostream>
 #include <chrono>
+#include <cmath>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
 
 using namespace QuantLib;
 
+namespace {
+
+    // counts the heap allocations made by the program, so that the
+    // sample loop of the engines can be checked for allocations
+    std::atomic<std::size_t> allocations(0);
+
+}
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
 int main() {
 
     try {
@@ -54,24 +84,147 @@ int main() {
 
         Size timeSteps = 10;
         Size mcSeed = 42;
-        ext::shared_ptr<PricingEngine> mcengine;
-        mcengine = MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
-            .withSteps(timeSteps)
-            .withAbsoluteTolerance(0.01)
-            .withSeed(mcSeed);
-        europeanOption.setPricingEngine(mcengine);
 
+        for (bool constantParameters : {false, true}) {
+
+            ext::shared_ptr<PricingEngine> mcengine;
+            mcengine = MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+                .withSteps(timeSteps)
+                .withAbsoluteTolerance(0.01)
+                .withSeed(mcSeed)
+                .withConstantParameters(constantParameters);
+            europeanOption.setPricingEngine(mcengine);
+
+            auto startTime = std::chrono::steady_clock::now();
+
+            Real NPV = europeanOption.NPV();
+
+            auto endTime = std::chrono::steady_clock::now();
+
+            double us = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+
+            std::cout << (constantParameters ? "Constant" : "Term-structure")
+                      << " parameters" << std::endl;
+            std::cout << "NPV: " << NPV << std::endl;
+            std::cout << "Error estimate: " << europeanOption.errorEstimate() << std::endl;
+            std::cout << "Elapsed time: " << us / 1000000 << " s" << std::endl;
+        }
+
+        // the batched kernel must agree with the path-based simulation
+        // within their statistical errors, both with a fixed number of
+        // samples and when stopping on a tolerance
+        for (bool withTolerance : {false, true}) {
+            Real NPVs[2], errors[2];
+            for (bool batched : {false, true}) {
+                MakeMCEuropeanEngine_2<PseudoRandom> factory(bsmProcess);
+                factory.withSteps(timeSteps)
+                    .withSeed(mcSeed)
+                    .withConstantParameters()
+                    .withBatchedKernel(batched);
+                if (withTolerance)
+                    factory.withAbsoluteTolerance(0.01);
+                else
+                    factory.withSamples(100000);
+                europeanOption.setPricingEngine(
+                                   ext::shared_ptr<PricingEngine>(factory));
+                NPVs[batched] = europeanOption.NPV();
+                errors[batched] = europeanOption.errorEstimate();
+            }
+            Real difference = std::fabs(NPVs[1] - NPVs[0]);
+            Real bound = 3.0*std::sqrt(errors[0]*errors[0]
+                                       + errors[1]*errors[1]);
+            std::cout << "Batched vs path-based ("
+                      << (withTolerance ? "tolerance" : "fixed samples")
+                      << "): " << NPVs[1] << " vs " << NPVs[0]
+                      << ", difference " << difference << std::endl;
+            QL_REQUIRE(difference <= bound,
+                       "batched and path-based prices differ by "
+                       << difference << ", more than " << bound);
+            QL_REQUIRE(!withTolerance ||
+                       (errors[0] <= 0.01 && errors[1] <= 0.01),
+                       "required tolerance not reached");
+        }
+
+        // after the setup, the sample loop must not allocate: pricing
+        // with different numbers of samples must make the same number
+        // of allocations in each simulation mode
+        struct AllocationTest {
+            std::string name;
+            bool constantParameters, batched;
+            Size threads;
+        };
+        std::vector<AllocationTest> allocationTests = {
+            {"term structures", false, false, 1},
+            {"constant parameters", true, false, 1},
+            {"batched kernel", true, true, 1},
+            {"two threads", true, false, 2}
+        };
+        for (const AllocationTest& test : allocationTests) {
+            Size samples[2] = {1000, 11000};
+            std::size_t counts[2];
+            for (Size i=0; i<2; ++i) {
+                europeanOption.setPricingEngine(
+                    MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+                    .withSteps(timeSteps)
+                    .withSamples(samples[i])
+                    .withSeed(mcSeed)
+                    .withConstantParameters(test.constantParameters)
+                    .withBatchedKernel(test.batched)
+                    .withThreads(test.threads));
+                std::size_t before = allocations;
+                europeanOption.NPV();
+                counts[i] = allocations - before;
+            }
+            Real perSample = (Real(counts[1]) - Real(counts[0]))
+                             / (samples[1] - samples[0]);
+            std::cout << "Allocations per sample (" << test.name << "): "
+                      << perSample << std::endl;
+            QL_REQUIRE(counts[0] == counts[1],
+                       test.name << ": " << counts[0] << " allocations for "
+                       << samples[0] << " samples, " << counts[1]
+                       << " for " << samples[1]);
+        }
+
+        // a portfolio priced on a single set of paths must agree with
+        // the same options priced one by one
+        std::vector<Real> strikes = {32.0, 36.0, 40.0, 44.0, 48.0};
+        std::vector<ext::shared_ptr<PlainVanillaPayoff> > payoffs;
+        for (Real k : strikes)
+            payoffs.push_back(ext::make_shared<PlainVanillaPayoff>(type, k));
+        Size portfolioSamples = 50000;
+
+        MCEuropeanPortfolio_2<PseudoRandom> portfolio(
+            bsmProcess, payoffs, maturity, timeSteps, portfolioSamples,
+            mcSeed, false, true);
         auto startTime = std::chrono::steady_clock::now();
-
-        Real NPV = europeanOption.NPV();
-
+        portfolio.calculate();
         auto endTime = std::chrono::steady_clock::now();
-
         double us = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
-
-        std::cout << "NPV: " << NPV << std::endl;
+        std::cout << "Portfolio of " << payoffs.size() << " options" << std::endl;
         std::cout << "Elapsed time: " << us / 1000000 << " s" << std::endl;
 
+        for (Size j=0; j<payoffs.size(); ++j) {
+            VanillaOption option(payoffs[j], europeanExercise);
+            option.setPricingEngine(
+                MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+                .withSteps(timeSteps)
+                .withSamples(portfolioSamples)
+                .withSeed(mcSeed)
+                .withConstantParameters());
+            Real difference = std::fabs(portfolio.NPV()[j] - option.NPV());
+            Real error = portfolio.errorEstimate()[j];
+            Real bound = 3.0*std::sqrt(error*error
+                                       + option.errorEstimate()
+                                         *option.errorEstimate());
+            std::cout << "Strike " << strikes[j] << ": "
+                      << portfolio.NPV()[j] << " vs " << option.NPV()
+                      << std::endl;
+            QL_REQUIRE(difference <= bound,
+                       "portfolio and single-option prices for strike "
+                       << strikes[j] << " differ by " << difference
+                       << ", more than " << bound);
+        }
+
         return 0;
 
     } catch (std::exception& e) {
@@ -26,29 +26,89 @@
 #ifndef montecarlo_european_engine_hpp
 #define montecarlo_european_engine_hpp
 
+#include "constantblackscholesprocess.hpp"
+#include "mceuropeanworkers.hpp"
+#include "randomshiftedrsg.hpp"
 #include <ql/pricingengines/vanilla/mcvanillaengine.hpp>
 #include <ql/processes/blackscholesprocess.hpp>
 #include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
 #include <ql/termstructures/volatility/equityfx/blackvariancecurve.hpp>
+#include <ql/math/randomnumbers/mt19937uniformrng.hpp>
+#include <ql/math/randomnumbers/seedgenerator.hpp>
+#include <ql/pricingengines/blackcalculator.hpp>
+#include <ql/math/randomnumbers/inversecumulativersg.hpp>
+#include <ql/math/distributions/normaldistribution.hpp>
+#include <exception>
+#include <thread>
 
 namespace QuantLib {
 
     //! European option pricing engine using Monte Carlo simulation
-    /*! \ingroup vanillaengines
+    /*! If constant parameters are required, the engine extracts
+        them from the passed process at the exercise date of the
+        option and simulates paths of a ConstantBlackScholesProcess
+        instead; this trades some accuracy for speed, since the
+        path generation no longer queries the term structures.
+
+        Since the payoff only depends on the terminal value of the
+        underlying, constant-parameter paths can also be sampled
+        exactly with a single log-normal step to maturity, regardless
+        of the number of steps otherwise requested; this saves both
+        random-number draws and path evolution.
+
+        Except when a control variate is used, samples are drawn by
+        simulation workers (see mceuropeanworkers.hpp) which reuse
+        their path and random-number buffers and accumulate running
+        statistics instead of storing every sample; no memory is
+        allocated in the sample loop.  For this reason, and unlike
+        the QuantLib engine, the class takes no statistics parameter:
+        the workers always use detail::MCAccumulator_2, and the
+        control-variate simulation, which runs through the base
+        McSimulation, uses the default Statistics class.
+
+        Constant-parameter simulations can also be spread over
+        several threads.  Each thread draws its own stream of
+        random numbers, seeded deterministically from the given
+        seed, so that results are reproducible for a given seed and
+        number of threads (but not across different numbers of
+        threads).
+
+        Finally, constant-parameter paths can be simulated by a
+        batched kernel which evolves blocks of paths at once and
+        evaluates the payoff without virtual calls; see
+        detail::MCEuropeanBatchWorker_2.
+
+        With constant parameters, the engine can also return delta,
+        vega and gamma from the same simulation used for the value:
+        delta and vega are pathwise estimators, while gamma uses a
+        likelihood-ratio estimator.  Their error estimates are
+        stored as additional results ("deltaErrorEstimate",
+        "vegaErrorEstimate" and "gammaErrorEstimate").
+
+        The closed-form Black-Scholes price for the constant
+        parameters can be used as a control variate.  The control
+        paths are simulated with the constant process, driven by the
+        same random numbers as the simulated ones; the reduction in
+        variance is therefore largest when the simulation itself
+        uses the full term structures.  (If it uses constant
+        parameters too, the control coincides with the option and
+        the engine returns the analytic price.)
+
+        \ingroup vanillaengines
 
         \test the correctness of the returned value is tested by
               checking it against analytic results.
     */
-    template <class RNG = PseudoRandom, class S = Statistics>
-    class MCEuropeanEngine_2 : public MCVanillaEngine<SingleVariate,RNG,S> {
+    template <class RNG = PseudoRandom>
+    class MCEuropeanEngine_2 : public MCVanillaEngine<SingleVariate,RNG> {
       public:
         typedef
-        typename MCVanillaEngine<SingleVariate,RNG,S>::path_generator_type
+        typename MCVanillaEngine<SingleVariate,RNG>::path_generator_type
             path_generator_type;
         typedef
-        typename MCVanillaEngine<SingleVariate,RNG,S>::path_pricer_type
+        typename MCVanillaEngine<SingleVariate,RNG>::path_pricer_type
             path_pricer_type;
-        typedef typename MCVanillaEngine<SingleVariate,RNG,S>::stats_type
+        typedef typename MCVanillaEngine<SingleVariate,RNG>::stats_type
             stats_type;
         // constructor
         MCEuropeanEngine_2(
@@ -60,13 +120,55 @@ namespace QuantLib {
              Size requiredSamples,
              Real requiredTolerance,
              Size maxSamples,
-             BigNatural seed);
+             BigNatural seed,
+             bool constantParameters = false,
+             bool exactTerminalSampling = false,
+             Size threads = 1,
+             bool batchedKernel = false,
+             bool greeks = false,
+             bool controlVariate = false,
+             Size replications = Null<Size>());
+        void calculate() const;
       protected:
+        TimeGrid timeGrid() const;
         boost::shared_ptr<path_pricer_type> pathPricer() const;
+        boost::shared_ptr<path_generator_type> pathGenerator() const;
+        boost::shared_ptr<path_pricer_type> controlPathPricer() const;
+        boost::shared_ptr<path_generator_type> controlPathGenerator() const;
+        Real controlVariateValue() const;
+        boost::shared_ptr<ConstantBlackScholesProcess>
+                                         constantProcess(Time maturity) const;
+        bool constantParameters_, exactTerminalSampling_;
+        Size threads_;
+        bool batchedKernel_, greeks_;
+        Size replications_;
+        // seed shared by simulated and control paths
+        mutable BigNatural simulationSeed_;
+      private:
+        typedef boost::shared_ptr<detail::MCEuropeanWorker_2> worker_type;
+        typedef InverseCumulativeRsg<
+                    RandomShiftedRsg_2<typename RNG::ursg_type>,
+                    InverseCumulativeNormal> rqmc_generator_type;
+        void calculateRandomizedQMC(
+                  const boost::shared_ptr<ConstantBlackScholesProcess>& process,
+                  const TimeGrid& grid) const;
+        template <class GSG>
+        worker_type worker(
+                  const boost::shared_ptr<ConstantBlackScholesProcess>& process,
+                  const TimeGrid& grid,
+                  const GSG& generator) const;
+        void addSamples(std::vector<worker_type>& workers,
+                        Size samples) const;
+        detail::MCAccumulator_2 accumulate(
+                   const std::vector<worker_type>& workers,
+                   Size quantity = detail::MCEuropeanWorker_2::Value) const;
+        detail::MCAccumulator_2 replicationMeans(
+                   const std::vector<worker_type>& workers,
+                   Size quantity = detail::MCEuropeanWorker_2::Value) const;
     };
 
     //! Monte Carlo European engine factory
-    template <class RNG = PseudoRandom, class S = Statistics>
+    template <class RNG = PseudoRandom>
     class MakeMCEuropeanEngine_2 {
       public:
         MakeMCEuropeanEngine_2(
@@ -80,6 +182,13 @@ namespace QuantLib {
         MakeMCEuropeanEngine_2& withMaxSamples(Size samples);
         MakeMCEuropeanEngine_2& withSeed(BigNatural seed);
         MakeMCEuropeanEngine_2& withAntitheticVariate(bool b = true);
+        MakeMCEuropeanEngine_2& withConstantParameters(bool b = true);
+        MakeMCEuropeanEngine_2& withExactTerminalSampling(bool b = true);
+        MakeMCEuropeanEngine_2& withThreads(Size threads);
+        MakeMCEuropeanEngine_2& withBatchedKernel(bool b = true);
+        MakeMCEuropeanEngine_2& withGreeks(bool b = true);
+        MakeMCEuropeanEngine_2& withControlVariate(bool b = true);
+        MakeMCEuropeanEngine_2& withRandomizedQMC(Size replications);
         // conversion to pricing engine
         operator boost::shared_ptr<PricingEngine>() const;
       private:
@@ -89,6 +198,10 @@ namespace QuantLib {
         Real tolerance_;
         bool brownianBridge_;
         BigNatural seed_;
+        bool constantParameters_, exactTerminalSampling_;
+        Size threads_;
+        bool batchedKernel_, greeks_, controlVariate_;
+        Size replications_;
     };
 
     class EuropeanPathPricer_2 : public PathPricer<Path> {
@@ -96,18 +209,44 @@ namespace QuantLib {
         EuropeanPathPricer_2(Option::Type type,
                              Real strike,
                              DiscountFactor discount);
+        /*! The parameters of the simulated process are needed for
+            the Greek estimators returned by sensitivities().
+        */
+        EuropeanPathPricer_2(
+                 Option::Type type,
+                 Real strike,
+                 DiscountFactor discount,
+                 const boost::shared_ptr<ConstantBlackScholesProcess>& process,
+                 Time maturity);
         Real operator()(const Path& path) const;
+        /*! Returns the discounted payoff for the given terminal
+            value of the underlying; unlike operator(), it performs
+            no checks and no virtual calls.
+        */
+        Real value(Real underlying) const;
+        /*! Returns the discounted payoff together with pathwise
+            estimators of delta and vega and a likelihood-ratio
+            estimator of gamma for the given path.
+        */
+        void sensitivities(const Path& path,
+                           Real& value,
+                           Real& delta,
+                           Real& vega,
+                           Real& gamma) const;
       private:
         PlainVanillaPayoff payoff_;
         DiscountFactor discount_;
+        Real strike_, omega_;
+        boost::shared_ptr<ConstantBlackScholesProcess> process_;
+        Time maturity_;
     };
 
 
     // inline definitions
 
-    template <class RNG, class S>
+    template <class RNG>
     inline
-    MCEuropeanEngine_2<RNG,S>::MCEuropeanEngine_2(
+    MCEuropeanEngine_2<RNG>::MCEuropeanEngine_2(
              const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
              Size timeSteps,
              Size timeStepsPerYear,
@@ -116,23 +255,360 @@ namespace QuantLib {
              Size requiredSamples,
              Real requiredTolerance,
              Size maxSamples,
-             BigNatural seed)
-    : MCVanillaEngine<SingleVariate,RNG,S>(process,
+             BigNatural seed,
+             bool constantParameters,
+             bool exactTerminalSampling,
+             Size threads,
+             bool batchedKernel,
+             bool greeks,
+             bool controlVariate,
+             Size replications)
+    : MCVanillaEngine<SingleVariate,RNG>(process,
                                            timeSteps,
                                            timeStepsPerYear,
                                            brownianBridge,
                                            antitheticVariate,
-                                           false,
+                                           controlVariate,
                                            requiredSamples,
                                            requiredTolerance,
                                            maxSamples,
-                                           seed) {}
+                                           seed),
+      constantParameters_(constantParameters),
+      exactTerminalSampling_(exactTerminalSampling), threads_(threads),
+      batchedKernel_(batchedKernel), greeks_(greeks),
+      replications_(replications), simulationSeed_(seed) {
+        QL_REQUIRE(constantParameters || !exactTerminalSampling,
+                   "exact terminal sampling requires constant parameters");
+        QL_REQUIRE(threads > 0, "at least one thread required");
+        // the workers stop on their own error estimate, which is
+        // only meaningful for pseudo-random or randomized samples
+        QL_REQUIRE(requiredTolerance == Null<Real>()
+                   || RNG::allowsErrorEstimate
+                   || replications != Null<Size>(),
+                   "chosen random generator policy "
+                   "does not allow an error estimate");
+        // term structures are not safe to share between threads
+        QL_REQUIRE(constantParameters || threads == 1,
+                   "multi-threaded simulation requires constant parameters");
+        QL_REQUIRE(RNG::allowsErrorEstimate || threads == 1
+                   || replications != Null<Size>(),
+                   "multi-threaded simulation requires a pseudo-random "
+                   "generator or randomized quasi-Monte Carlo");
+        QL_REQUIRE(constantParameters || !batchedKernel,
+                   "batched kernel requires constant parameters");
+        QL_REQUIRE(constantParameters || !greeks,
+                   "Greeks require constant parameters");
+        QL_REQUIRE(!controlVariate ||
+                   (threads == 1 && !batchedKernel && !greeks),
+                   "control variate not available for multi-threaded, "
+                   "batched or Greek simulations");
+        QL_REQUIRE(replications == Null<Size>() || replications > 1,
+                   "at least two replications required");
+        QL_REQUIRE(replications == Null<Size>() || !RNG::allowsErrorEstimate,
+                   "randomized quasi-Monte Carlo requires "
+                   "a low-discrepancy generator");
+        QL_REQUIRE(replications == Null<Size>() || !controlVariate,
+                   "control variate not available for "
+                   "randomized quasi-Monte Carlo");
+    }
+
+
+    template <class RNG>
+    inline void MCEuropeanEngine_2<RNG>::calculate() const {
+
+        if (this->controlVariate_) {
+            // simulated and control paths must be driven by the
+            // same random numbers, even if no seed was given
+            simulationSeed_ = this->seed_ != 0 ?
+                this->seed_ : SeedGenerator::instance().get();
+            MCVanillaEngine<SingleVariate,RNG>::calculate();
+            return;
+        }
+
+        QL_REQUIRE(this->requiredTolerance_ != Null<Real>() ||
+                   this->requiredSamples_ != Null<Size>(),
+                   "neither tolerance nor number of samples set");
+
+        TimeGrid grid = this->timeGrid();
+        boost::shared_ptr<ConstantBlackScholesProcess> process =
+            constantProcess(grid.back());
+
+        if (replications_ != Null<Size>()) {
+            calculateRandomizedQMC(process, grid);
+            return;
+        }
+
+        // each worker gets its own random stream; seeds are drawn
+        // in a fixed order so that the streams are reproducible.
+        // A single worker uses the engine seed as is.
+        MersenneTwisterUniformRng seeds(this->seed_);
+        std::vector<worker_type> workers;
+        for (Size k=0; k<threads_; ++k) {
+            BigNatural seed = this->seed_;
+            if (threads_ > 1 && this->seed_ != 0)
+                seed = seeds.nextInt32();
+            workers.push_back(
+                worker(process, grid,
+                       RNG::make_sequence_generator(grid.size()-1, seed)));
+        }
+
+        if (this->requiredTolerance_ != Null<Real>()) {
+            // same stopping rule as McSimulation::value
+            Size maxSamples = this->maxSamples_ != Null<Size>() ?
+                this->maxSamples_ : QL_MAX_INTEGER;
+            Size minSamples = 1023;
+            addSamples(workers, minSamples);
+            Size sampleNumber = minSamples;
+            Real error = accumulate(workers).errorEstimate();
+            while (error > this->requiredTolerance_) {
+                QL_REQUIRE(sampleNumber<maxSamples,
+                           "max number of samples (" << maxSamples
+                           << ") reached, while error (" << error
+                           << ") is still above tolerance ("
+                           << this->requiredTolerance_ << ")");
+                Real order = error*error/this->requiredTolerance_
+                                        /this->requiredTolerance_;
+                Size nextBatch =
+                    Size(std::max<Real>(sampleNumber*order*0.8
+                                        - sampleNumber,
+                                        Real(minSamples)));
+                nextBatch = std::min(nextBatch, maxSamples-sampleNumber);
+                sampleNumber += nextBatch;
+                addSamples(workers, nextBatch);
+                error = accumulate(workers).errorEstimate();
+            }
+        } else {
+            addSamples(workers, this->requiredSamples_);
+        }
+
+        detail::MCAccumulator_2 total = accumulate(workers);
+        this->results_.value = total.mean();
+        if (RNG::allowsErrorEstimate)
+            this->results_.errorEstimate = total.errorEstimate();
+
+        if (greeks_) {
+            detail::MCAccumulator_2 delta =
+                accumulate(workers, detail::MCEuropeanWorker_2::Delta);
+            detail::MCAccumulator_2 vega =
+                accumulate(workers, detail::MCEuropeanWorker_2::Vega);
+            detail::MCAccumulator_2 gamma =
+                accumulate(workers, detail::MCEuropeanWorker_2::Gamma);
+            this->results_.delta = delta.mean();
+            this->results_.vega = vega.mean();
+            this->results_.gamma = gamma.mean();
+            if (RNG::allowsErrorEstimate) {
+                this->results_.additionalResults["deltaErrorEstimate"] =
+                    delta.errorEstimate();
+                this->results_.additionalResults["vegaErrorEstimate"] =
+                    vega.errorEstimate();
+                this->results_.additionalResults["gammaErrorEstimate"] =
+                    gamma.errorEstimate();
+            }
+        }
+    }
 
 
-    template <class RNG, class S>
+    template <class RNG>
+    inline void MCEuropeanEngine_2<RNG>::calculateRandomizedQMC(
+                  const boost::shared_ptr<ConstantBlackScholesProcess>& process,
+                  const TimeGrid& grid) const {
+
+        // all replications run the same low-discrepancy sequence,
+        // each with its own random shift
+        Size dimension = grid.size()-1;
+        typename RNG::ursg_type sequence(dimension, this->seed_);
+        MersenneTwisterUniformRng shifts(this->seed_);
+        std::vector<worker_type> workers;
+        for (Size k=0; k<replications_; ++k) {
+            rqmc_generator_type generator(
+                RandomShiftedRsg_2<typename RNG::ursg_type>(
+                                              sequence, shifts.nextInt32()));
+            workers.push_back(worker(process, grid, generator));
+        }
+
+        Size R = replications_;
+        Size points;
+        if (this->requiredTolerance_ != Null<Real>()) {
+            Size maxSamples = this->maxSamples_ != Null<Size>() ?
+                this->maxSamples_ : QL_MAX_INTEGER;
+            // the error is expected to decrease roughly as 1/N, so
+            // the number of points per replication is doubled until
+            // the tolerance is met; powers of two also preserve the
+            // equidistribution of Sobol sequences
+            points = 1024;
+            addSamples(workers, points*R);
+            Real error = replicationMeans(workers).errorEstimate();
+            while (error > this->requiredTolerance_) {
+                QL_REQUIRE(points*R < maxSamples,
+                           "max number of samples (" << maxSamples
+                           << ") reached, while error (" << error
+                           << ") is still above tolerance ("
+                           << this->requiredTolerance_ << ")");
+                Size nextBatch = std::min(points, maxSamples/R - points);
+                QL_REQUIRE(nextBatch > 0,
+                           "max number of samples (" << maxSamples
+                           << ") too low for " << R << " replications");
+                addSamples(workers, nextBatch*R);
+                points += nextBatch;
+                error = replicationMeans(workers).errorEstimate();
+            }
+        } else {
+            points = (this->requiredSamples_ + R - 1)/R;
+            addSamples(workers, points*R);
+        }
+
+        // the estimate is the average of the replications, and its
+        // error is the standard error of their means
+        detail::MCAccumulator_2 value = replicationMeans(workers);
+        this->results_.value = value.mean();
+        this->results_.errorEstimate = value.errorEstimate();
+
+        if (greeks_) {
+            detail::MCAccumulator_2 delta =
+                replicationMeans(workers, detail::MCEuropeanWorker_2::Delta);
+            detail::MCAccumulator_2 vega =
+                replicationMeans(workers, detail::MCEuropeanWorker_2::Vega);
+            detail::MCAccumulator_2 gamma =
+                replicationMeans(workers, detail::MCEuropeanWorker_2::Gamma);
+            this->results_.delta = delta.mean();
+            this->results_.vega = vega.mean();
+            this->results_.gamma = gamma.mean();
+            this->results_.additionalResults["deltaErrorEstimate"] =
+                delta.errorEstimate();
+            this->results_.additionalResults["vegaErrorEstimate"] =
+                vega.errorEstimate();
+            this->results_.additionalResults["gammaErrorEstimate"] =
+                gamma.errorEstimate();
+        }
+    }
+
+
+    template <class RNG>
+    template <class GSG>
+    inline typename MCEuropeanEngine_2<RNG>::worker_type
+    MCEuropeanEngine_2<RNG>::worker(
+                  const boost::shared_ptr<ConstantBlackScholesProcess>& process,
+                  const TimeGrid& grid,
+                  const GSG& generator) const {
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        boost::shared_ptr<GeneralizedBlackScholesProcess> bsProcess =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                this->process_);
+        QL_REQUIRE(bsProcess, "Black-Scholes process required");
+        DiscountFactor discount =
+            bsProcess->riskFreeRate()->discount(grid.back());
+
+        if (batchedKernel_) {
+            return worker_type(
+                new detail::MCEuropeanBatchWorker_2<GSG>(
+                    *process, grid, generator, this->brownianBridge_,
+                    this->antitheticVariate_, *payoff, discount, greeks_));
+        } else {
+            // without constant parameters, the paths follow the
+            // full process; the constant one is only used by the
+            // Greek estimators, which require constant parameters
+            boost::shared_ptr<StochasticProcess> simulated = this->process_;
+            if (constantParameters_)
+                simulated = process;
+            boost::shared_ptr<EuropeanPathPricer_2> pricer(
+                new EuropeanPathPricer_2(payoff->optionType(),
+                                         payoff->strike(), discount,
+                                         process, grid.back()));
+            return worker_type(
+                new detail::MCEuropeanPathWorker_2<PathGenerator<GSG>,
+                                                   EuropeanPathPricer_2>(
+                    boost::shared_ptr<PathGenerator<GSG> >(
+                        new PathGenerator<GSG>(simulated, grid, generator,
+                                               this->brownianBridge_)),
+                    pricer, this->antitheticVariate_, greeks_));
+        }
+    }
+
+
+    template <class RNG>
+    inline void MCEuropeanEngine_2<RNG>::addSamples(
+                                            std::vector<worker_type>& workers,
+                                            Size samples) const {
+        Size n = workers.size();
+        Size m = std::min(n, threads_);
+        // deterministic split of the samples among the workers
+        std::vector<Size> shares(n);
+        for (Size k=0; k<n; ++k)
+            shares[k] = samples/n + (k < samples%n ? 1 : 0);
+        if (m == 1) {
+            for (Size k=0; k<n; ++k)
+                workers[k]->addSamples(shares[k]);
+            return;
+        }
+        // each thread runs a contiguous group of workers
+        std::vector<std::exception_ptr> errors(m);
+        std::vector<std::thread> threads;
+        threads.reserve(m);
+        for (Size j=0; j<m; ++j) {
+            Size first = j*n/m, last = (j+1)*n/m;
+            threads.push_back(std::thread(
+                [&workers, &shares, &errors, j, first, last]() {
+                    try {
+                        for (Size k=first; k<last; ++k)
+                            workers[k]->addSamples(shares[k]);
+                    } catch (...) {
+                        errors[j] = std::current_exception();
+                    }
+                }));
+        }
+        for (Size j=0; j<m; ++j)
+            threads[j].join();
+        for (Size j=0; j<m; ++j) {
+            if (errors[j])
+                std::rethrow_exception(errors[j]);
+        }
+    }
+
+
+    template <class RNG>
+    inline detail::MCAccumulator_2 MCEuropeanEngine_2<RNG>::accumulate(
+                                       const std::vector<worker_type>& workers,
+                                       Size quantity) const {
+        detail::MCAccumulator_2 total;
+        for (Size k=0; k<workers.size(); ++k)
+            total.add(workers[k]->accumulator(quantity));
+        return total;
+    }
+
+
+    template <class RNG>
+    inline detail::MCAccumulator_2
+    MCEuropeanEngine_2<RNG>::replicationMeans(
+                                       const std::vector<worker_type>& workers,
+                                       Size quantity) const {
+        detail::MCAccumulator_2 means;
+        for (Size k=0; k<workers.size(); ++k)
+            means.add(workers[k]->accumulator(quantity).mean());
+        return means;
+    }
+
+
+    template <class RNG>
+    inline TimeGrid MCEuropeanEngine_2<RNG>::timeGrid() const {
+
+        if (!exactTerminalSampling_)
+            return MCVanillaEngine<SingleVariate,RNG>::timeGrid();
+
+        // a single exact step to maturity
+        Date lastExerciseDate = this->arguments_.exercise->lastDate();
+        Time t = this->process_->time(lastExerciseDate);
+        return TimeGrid(t, 1);
+    }
+
+
+    template <class RNG>
     inline
-    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>
-    MCEuropeanEngine_2<RNG,S>::pathPricer() const {
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG>::path_pricer_type>
+    MCEuropeanEngine_2<RNG>::pathPricer() const {
 
         boost::shared_ptr<PlainVanillaPayoff> payoff =
             boost::dynamic_pointer_cast<PlainVanillaPayoff>(
@@ -145,7 +621,7 @@ namespace QuantLib {
         QL_REQUIRE(process, "Black-Scholes process required");
 
         return boost::shared_ptr<
-                       typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>(
+                       typename MCEuropeanEngine_2<RNG>::path_pricer_type>(
           new EuropeanPathPricer_2(
               payoff->optionType(),
               payoff->strike(),
@@ -153,94 +629,245 @@ namespace QuantLib {
     }
 
 
-    template <class RNG, class S>
-    inline MakeMCEuropeanEngine_2<RNG,S>::MakeMCEuropeanEngine_2(
+    template <class RNG>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG>::path_generator_type>
+    MCEuropeanEngine_2<RNG>::pathGenerator() const {
+
+        TimeGrid grid = this->timeGrid();
+        boost::shared_ptr<StochasticProcess> process = this->process_;
+        if (constantParameters_)
+            process = constantProcess(grid.back());
+
+        typename RNG::rsg_type generator =
+            RNG::make_sequence_generator(grid.size()-1, simulationSeed_);
+        return boost::shared_ptr<path_generator_type>(
+                   new path_generator_type(process, grid, generator,
+                                           this->brownianBridge_));
+    }
+
+
+    template <class RNG>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG>::path_pricer_type>
+    MCEuropeanEngine_2<RNG>::controlPathPricer() const {
+        // same payoff and discount, applied to the control paths
+        return pathPricer();
+    }
+
+
+    template <class RNG>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG>::path_generator_type>
+    MCEuropeanEngine_2<RNG>::controlPathGenerator() const {
+
+        TimeGrid grid = this->timeGrid();
+        typename RNG::rsg_type generator =
+            RNG::make_sequence_generator(grid.size()-1, simulationSeed_);
+        return boost::shared_ptr<path_generator_type>(
+                   new path_generator_type(constantProcess(grid.back()),
+                                           grid, generator,
+                                           this->brownianBridge_));
+    }
+
+
+    template <class RNG>
+    inline Real MCEuropeanEngine_2<RNG>::controlVariateValue() const {
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        Time maturity = this->timeGrid().back();
+        boost::shared_ptr<ConstantBlackScholesProcess> process =
+            constantProcess(maturity);
+
+        Real forward = process->x0() *
+            std::exp((process->riskFreeRate() - process->dividendYield())
+                     * maturity);
+        Real stdDev = process->stdDeviation(0.0, process->x0(), maturity);
+        DiscountFactor discount =
+            std::exp(-process->riskFreeRate() * maturity);
+
+        return BlackCalculator(payoff, forward, stdDev, discount).value();
+    }
+
+
+    template <class RNG>
+    inline boost::shared_ptr<ConstantBlackScholesProcess>
+    MCEuropeanEngine_2<RNG>::constantProcess(Time maturity) const {
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+
+        return boost::shared_ptr<ConstantBlackScholesProcess>(
+            new ConstantBlackScholesProcess(process, maturity,
+                                            payoff->strike()));
+    }
+
+
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>::MakeMCEuropeanEngine_2(
              const boost::shared_ptr<GeneralizedBlackScholesProcess>& process)
     : process_(process), antithetic_(false),
       steps_(Null<Size>()), stepsPerYear_(Null<Size>()),
       samples_(Null<Size>()), maxSamples_(Null<Size>()),
-      tolerance_(Null<Real>()), brownianBridge_(false), seed_(0) {}
-
-    template <class RNG, class S>
-    inline MakeMCEuropeanEngine_2<RNG,S>&
-    MakeMCEuropeanEngine_2<RNG,S>::withSteps(Size steps) {
+      tolerance_(Null<Real>()), brownianBridge_(false), seed_(0),
+      constantParameters_(false), exactTerminalSampling_(false),
+      threads_(1), batchedKernel_(false), greeks_(false),
+      controlVariate_(false), replications_(Null<Size>()) {}
+
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withSteps(Size steps) {
         steps_ = steps;
         return *this;
     }
 
-    template <class RNG, class S>
-    inline MakeMCEuropeanEngine_2<RNG,S>&
-    MakeMCEuropeanEngine_2<RNG,S>::withStepsPerYear(Size steps) {
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withStepsPerYear(Size steps) {
         stepsPerYear_ = steps;
         return *this;
     }
 
-    template <class RNG, class S>
-    inline MakeMCEuropeanEngine_2<RNG,S>&
-    MakeMCEuropeanEngine_2<RNG,S>::withSamples(Size samples) {
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withSamples(Size samples) {
         QL_REQUIRE(tolerance_ == Null<Real>(),
                    "tolerance already set");
         samples_ = samples;
         return *this;
     }
 
-    template <class RNG, class S>
-    inline MakeMCEuropeanEngine_2<RNG,S>&
-    MakeMCEuropeanEngine_2<RNG,S>::withAbsoluteTolerance(Real tolerance) {
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withAbsoluteTolerance(Real tolerance) {
         QL_REQUIRE(samples_ == Null<Size>(),
                    "number of samples already set");
-        QL_REQUIRE(RNG::allowsErrorEstimate,
-                   "chosen random generator policy "
-                   "does not allow an error estimate");
         tolerance_ = tolerance;
         return *this;
     }
 
-    template <class RNG, class S>
-    inline MakeMCEuropeanEngine_2<RNG,S>&
-    MakeMCEuropeanEngine_2<RNG,S>::withMaxSamples(Size samples) {
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withMaxSamples(Size samples) {
         maxSamples_ = samples;
         return *this;
     }
 
-    template <class RNG, class S>
-    inline MakeMCEuropeanEngine_2<RNG,S>&
-    MakeMCEuropeanEngine_2<RNG,S>::withSeed(BigNatural seed) {
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withSeed(BigNatural seed) {
         seed_ = seed;
         return *this;
     }
 
-    template <class RNG, class S>
-    inline MakeMCEuropeanEngine_2<RNG,S>&
-    MakeMCEuropeanEngine_2<RNG,S>::withBrownianBridge(bool brownianBridge) {
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withBrownianBridge(bool brownianBridge) {
         brownianBridge_ = brownianBridge;
         return *this;
     }
 
-    template <class RNG, class S>
-    inline MakeMCEuropeanEngine_2<RNG,S>&
-    MakeMCEuropeanEngine_2<RNG,S>::withAntitheticVariate(bool b) {
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withAntitheticVariate(bool b) {
         antithetic_ = b;
         return *this;
     }
 
-    template <class RNG, class S>
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withConstantParameters(bool b) {
+        constantParameters_ = b;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withExactTerminalSampling(bool b) {
+        exactTerminalSampling_ = b;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withThreads(Size threads) {
+        threads_ = threads;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withBatchedKernel(bool b) {
+        batchedKernel_ = b;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withGreeks(bool b) {
+        greeks_ = b;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withControlVariate(bool b) {
+        controlVariate_ = b;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMCEuropeanEngine_2<RNG>&
+    MakeMCEuropeanEngine_2<RNG>::withRandomizedQMC(Size replications) {
+        replications_ = replications;
+        return *this;
+    }
+
+    template <class RNG>
     inline
-    MakeMCEuropeanEngine_2<RNG,S>::operator boost::shared_ptr<PricingEngine>()
+    MakeMCEuropeanEngine_2<RNG>::operator boost::shared_ptr<PricingEngine>()
                                                                       const {
-        QL_REQUIRE(steps_ != Null<Size>() || stepsPerYear_ != Null<Size>(),
+        QL_REQUIRE(steps_ != Null<Size>() || stepsPerYear_ != Null<Size>()
+                   || exactTerminalSampling_,
                    "number of steps not given");
         QL_REQUIRE(steps_ == Null<Size>() || stepsPerYear_ == Null<Size>(),
                    "number of steps overspecified");
+        QL_REQUIRE(tolerance_ == Null<Real>() || RNG::allowsErrorEstimate
+                   || replications_ != Null<Size>(),
+                   "chosen random generator policy "
+                   "does not allow an error estimate");
+        // the steps are ignored by exact terminal sampling, but the
+        // base engine still requires them
+        Size steps = steps_;
+        if (steps_ == Null<Size>() && stepsPerYear_ == Null<Size>())
+            steps = 1;
         return boost::shared_ptr<PricingEngine>(new
-            MCEuropeanEngine_2<RNG,S>(process_,
-                                      steps_,
+            MCEuropeanEngine_2<RNG>(process_,
+                                      steps,
                                       stepsPerYear_,
                                       brownianBridge_,
                                       antithetic_,
                                       samples_, tolerance_,
                                       maxSamples_,
-                                      seed_));
+                                      seed_,
+                                      constantParameters_,
+                                      exactTerminalSampling_,
+                                      threads_,
+                                      batchedKernel_,
+                                      greeks_,
+                                      controlVariate_,
+                                      replications_));
     }
 
 
@@ -248,14 +875,62 @@ namespace QuantLib {
     inline EuropeanPathPricer_2::EuropeanPathPricer_2(Option::Type type,
                                                       Real strike,
                                                       DiscountFactor discount)
-    : payoff_(type, strike), discount_(discount) {
+    : payoff_(type, strike), discount_(discount), strike_(strike),
+      omega_(type == Option::Call ? 1.0 : -1.0) {
         QL_REQUIRE(strike>=0.0,
                    "strike less than zero not allowed");
     }
 
+    inline EuropeanPathPricer_2::EuropeanPathPricer_2(
+                 Option::Type type,
+                 Real strike,
+                 DiscountFactor discount,
+                 const boost::shared_ptr<ConstantBlackScholesProcess>& process,
+                 Time maturity)
+    : payoff_(type, strike), discount_(discount), strike_(strike),
+      omega_(type == Option::Call ? 1.0 : -1.0), process_(process),
+      maturity_(maturity) {
+        QL_REQUIRE(strike>=0.0,
+                   "strike less than zero not allowed");
+        QL_REQUIRE(maturity > 0.0, "positive maturity required");
+    }
+
     inline Real EuropeanPathPricer_2::operator()(const Path& path) const {
         QL_REQUIRE(path.length() > 0, "the path cannot be empty");
-        return payoff_(path.back()) * discount_;
+        return value(path.back());
+    }
+
+    inline Real EuropeanPathPricer_2::value(Real underlying) const {
+        return discount_ * std::max(omega_*(underlying - strike_), 0.0);
+    }
+
+    inline void EuropeanPathPricer_2::sensitivities(const Path& path,
+                                                    Real& value,
+                                                    Real& delta,
+                                                    Real& vega,
+                                                    Real& gamma) const {
+        QL_REQUIRE(path.length() > 0, "the path cannot be empty");
+        QL_REQUIRE(process_, "process parameters not given");
+        Volatility sigma = process_->volatility();
+        QL_REQUIRE(sigma > 0.0, "positive volatility required for Greeks");
+
+        Real x0 = path.front(), ST = path.back();
+        Real sqrtT = std::sqrt(maturity_);
+        // Brownian motion at maturity driving the path
+        Real w = (std::log(ST/x0) - process_->drift(0.0, x0)*maturity_)/sigma;
+        Real z = w/sqrtT;
+        Real omega = payoff_.optionType() == Option::Call ? 1.0 : -1.0;
+        Real itm = omega*(ST - payoff_.strike()) > 0.0 ?
+            discount_*omega : 0.0;
+
+        value = payoff_(ST) * discount_;
+        // dS_T/dS_0 = S_T/S_0
+        delta = itm * ST/x0;
+        // dS_T/dsigma = S_T (W_T - sigma T)
+        vega = itm * ST * (w - sigma*maturity_);
+        // likelihood-ratio weight for the second derivative in S_0
+        gamma = value * (z*z - 1.0 - sigma*sqrtT*z) /
+            (x0*x0*sigma*sigma*maturity_);
     }
 
 }
@@ -0,0 +1,165 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file mceuropeanportfolio.hpp
+    \brief Monte Carlo pricing of many European options on one set of paths
+*/
+
+#ifndef montecarlo_european_portfolio_hpp
+#define montecarlo_european_portfolio_hpp
+
+#include "constantblackscholesprocess.hpp"
+#include "mceuropeanworkers.hpp"
+#include <ql/methods/montecarlo/pathgenerator.hpp>
+#include <ql/pricingengines/mcsimulation.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+
+namespace QuantLib {
+
+    //! Monte Carlo pricer for a portfolio of European options
+    /*! All the options must share the underlying and the maturity.
+        Paths are simulated once; each payoff is evaluated on the
+        terminal value of every path and accumulated separately, so
+        that values and error estimates for the whole portfolio are
+        obtained in a single pass.
+
+        If constant parameters are used, the volatility is the Black
+        volatility at maturity for the current underlying value,
+        since the paths can't depend on the individual strikes.
+
+        Unlike the engines, the pricer takes no statistics class:
+        each payoff is accumulated in a detail::MCAccumulator_2,
+        which keeps a running mean and variance instead of storing
+        every sample as Statistics does.  Only values and error
+        estimates are therefore available, not the other statistics
+        (percentiles, skewness etc.) that Statistics would provide.
+    */
+    template <class RNG = PseudoRandom>
+    class MCEuropeanPortfolio_2 {
+      public:
+        typedef typename RNG::rsg_type rsg_type;
+        typedef PathGenerator<rsg_type> path_generator_type;
+        MCEuropeanPortfolio_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const std::vector<boost::shared_ptr<PlainVanillaPayoff> >& payoffs,
+             const Date& maturity,
+             Size timeSteps,
+             Size samples,
+             BigNatural seed = 0,
+             bool antitheticVariate = false,
+             bool constantParameters = false);
+        void calculate();
+        //! \name Results
+        //@{
+        const std::vector<Real>& NPV() const { return values_; }
+        const std::vector<Real>& errorEstimate() const {
+            return errors_;
+        }
+        //@}
+      private:
+        void evaluate(const Real* terminal, Size n, Size j,
+                      Real* prices) const;
+        enum { blockSize = 64 };
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Date maturity_;
+        Size timeSteps_, samples_;
+        BigNatural seed_;
+        bool antitheticVariate_, constantParameters_;
+        std::vector<Real> strikes_, omegas_;
+        DiscountFactor discount_;
+        std::vector<Real> values_, errors_;
+    };
+
+
+    // template definitions
+
+    template <class RNG>
+    MCEuropeanPortfolio_2<RNG>::MCEuropeanPortfolio_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const std::vector<boost::shared_ptr<PlainVanillaPayoff> >& payoffs,
+             const Date& maturity,
+             Size timeSteps,
+             Size samples,
+             BigNatural seed,
+             bool antitheticVariate,
+             bool constantParameters)
+    : process_(process), maturity_(maturity), timeSteps_(timeSteps),
+      samples_(samples), seed_(seed), antitheticVariate_(antitheticVariate),
+      constantParameters_(constantParameters), discount_(1.0) {
+        QL_REQUIRE(!payoffs.empty(), "no payoffs given");
+        QL_REQUIRE(timeSteps > 0, "at least one time step required");
+        QL_REQUIRE(samples > 1, "at least two samples required");
+        for (Size j=0; j<payoffs.size(); ++j) {
+            QL_REQUIRE(payoffs[j]->strike() >= 0.0,
+                       "strike less than zero not allowed");
+            strikes_.push_back(payoffs[j]->strike());
+            omegas_.push_back(
+                payoffs[j]->optionType() == Option::Call ? 1.0 : -1.0);
+        }
+    }
+
+    template <class RNG>
+    void MCEuropeanPortfolio_2<RNG>::calculate() {
+
+        Time t = process_->time(maturity_);
+        TimeGrid grid(t, timeSteps_);
+        discount_ = process_->riskFreeRate()->discount(t);
+
+        boost::shared_ptr<StochasticProcess1D> process = process_;
+        if (constantParameters_)
+            process = boost::shared_ptr<StochasticProcess1D>(
+                     new ConstantBlackScholesProcess(process_, t,
+                                                     process_->x0()));
+
+        path_generator_type generator(
+                     process, grid,
+                     RNG::make_sequence_generator(timeSteps_, seed_),
+                     false);
+
+        Size n = strikes_.size();
+        std::vector<detail::MCAccumulator_2> accumulators(n);
+        Real terminal[blockSize], atTerminal[blockSize];
+        Real prices[blockSize], atPrices[blockSize];
+
+        for (Size done = 0; done < samples_; ) {
+            Size m = std::min<Size>(samples_ - done, blockSize);
+            for (Size p=0; p<m; ++p) {
+                terminal[p] = generator.next().value.back();
+                if (antitheticVariate_)
+                    atTerminal[p] = generator.antithetic().value.back();
+            }
+            for (Size j=0; j<n; ++j) {
+                evaluate(terminal, m, j, prices);
+                if (antitheticVariate_) {
+                    evaluate(atTerminal, m, j, atPrices);
+                    for (Size p=0; p<m; ++p)
+                        prices[p] = (prices[p] + atPrices[p])/2.0;
+                }
+                accumulators[j].add(prices, prices+m);
+            }
+            done += m;
+        }
+
+        values_.resize(n);
+        errors_.resize(n);
+        for (Size j=0; j<n; ++j) {
+            values_[j] = accumulators[j].mean();
+            if (RNG::allowsErrorEstimate)
+                errors_[j] = accumulators[j].errorEstimate();
+            else
+                errors_[j] = Null<Real>();
+        }
+    }
+
+    template <class RNG>
+    inline void MCEuropeanPortfolio_2<RNG>::evaluate(const Real* terminal,
+                                                     Size n, Size j,
+                                                     Real* prices) const {
+        Real strike = strikes_[j], omega = omegas_[j];
+        for (Size p=0; p<n; ++p)
+            prices[p] = discount_ * std::max(omega*(terminal[p]-strike), 0.0);
+    }
+
+}
+
+
+#endif
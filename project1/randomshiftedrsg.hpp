@@ -0,0 +1,61 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file randomshiftedrsg.hpp
+    \brief Randomly shifted uniform sequence generator
+*/
+
+#ifndef random_shifted_rsg_hpp
+#define random_shifted_rsg_hpp
+
+#include <ql/math/randomnumbers/mt19937uniformrng.hpp>
+#include <ql/methods/montecarlo/sample.hpp>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Randomly shifted uniform sequence generator
+    /*! Each point of the underlying sequence is shifted by a fixed
+        random vector, modulo 1 (Cranley-Patterson rotation).  Applied
+        to a low-discrepancy sequence, independent shifts give
+        independent, unbiased replications of the quasi-Monte Carlo
+        estimate, whose spread provides an error estimate.
+
+        Unlike RandomizedLDS, the shift is drawn once at construction
+        and no memory is allocated when drawing a sequence.
+    */
+    template <class USG>
+    class RandomShiftedRsg_2 {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        RandomShiftedRsg_2(const USG& generator, BigNatural shiftSeed)
+        : generator_(generator), dimension_(generator.dimension()),
+          sequence_(std::vector<Real>(dimension_), 1.0),
+          shift_(dimension_) {
+            MersenneTwisterUniformRng rng(shiftSeed);
+            for (Size i=0; i<dimension_; ++i)
+                shift_[i] = rng.nextReal();
+        }
+        const sample_type& nextSequence() const {
+            const std::vector<Real>& x = generator_.nextSequence().value;
+            for (Size i=0; i<dimension_; ++i) {
+                Real u = x[i] + shift_[i];
+                if (u >= 1.0)
+                    u -= 1.0;
+                // keep away from 0, where the inverse normal diverges
+                sequence_.value[i] = u > 0.0 ? u : QL_EPSILON;
+            }
+            return sequence_;
+        }
+        const sample_type& lastSequence() const { return sequence_; }
+        Size dimension() const { return dimension_; }
+      private:
+        mutable USG generator_;
+        Size dimension_;
+        mutable sample_type sequence_;
+        std::vector<Real> shift_;
+    };
+
+}
+
+
+#endif
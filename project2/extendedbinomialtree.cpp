@@ -130,27 +130,27 @@ namespace QuantLib {
         QL_REQUIRE(pu_>=0.0, "negative probability");
     }
 
-    Real ExtendedTian_2::underlying(Size i, Size index) const {
-        Time stepTime = i*this->dt_;
+    void ExtendedTian_2::computeStep(Time stepTime,
+                                     StepParameters& p) const {
         Real q = std::exp(this->treeProcess_->variance(stepTime, x0_, dt_));
         Real r = std::exp(this->driftStep(stepTime))*std::sqrt(q);
 
         Real up = 0.5 * r * q * (q + 1 + std::sqrt(q * q + 2 * q - 3));
         Real down = 0.5 * r * q * (q + 1 - std::sqrt(q * q + 2 * q - 3));
 
-        return x0_ * std::pow(down, Real(BigInteger(i)-BigInteger(index)))
-            * std::pow(up, Real(index));
+        p[0] = up;
+        p[1] = down;
+        p[2] = (r - down) / (up - down);
     }
 
-    Real ExtendedTian_2::probability(Size i, Size, Size branch) const {
-        Time stepTime = i*this->dt_;
-        Real q = std::exp(this->treeProcess_->variance(stepTime, x0_, dt_));
-        Real r = std::exp(this->driftStep(stepTime))*std::sqrt(q);
-
-        Real up = 0.5 * r * q * (q + 1 + std::sqrt(q * q + 2 * q - 3));
-        Real down = 0.5 * r * q * (q + 1 - std::sqrt(q * q + 2 * q - 3));
+    Real ExtendedTian_2::underlying(Size i, Size index) const {
+        const StepParameters& p = step(i);
+        return x0_ * std::pow(p[1], Real(BigInteger(i)-BigInteger(index)))
+            * std::pow(p[0], Real(index));
+    }
 
-        Real pu = (r - down) / (up - down);
+    Real ExtendedTian_2::probability(Size i, Size, Size branch) const {
+        Real pu = step(i)[2];
         Real pd = 1.0 - pu;
 
         return (branch == 1 ? pu : pd);
@@ -180,8 +180,8 @@ namespace QuantLib {
 
     }
 
-    Real ExtendedLeisenReimer_2::underlying(Size i, Size index) const {
-        Time stepTime = i*this->dt_;
+    void ExtendedLeisenReimer_2::computeStep(Time stepTime,
+                                             StepParameters& p) const {
         Real variance = this->treeProcess_->variance(stepTime, x0_, end_);
         Real ermqdt = std::exp(this->driftStep(stepTime) + 0.5*variance/oddSteps_);
         Real d2 = (std::log(x0_/strike_) + this->driftStep(stepTime)*oddSteps_ ) /
@@ -191,19 +191,19 @@ namespace QuantLib {
         Real pdash = PeizerPrattMethod2Inversion(d2+std::sqrt(variance),
             oddSteps_);
         Real up = ermqdt * pdash / pu;
-        Real down = (ermqdt - pu * up) / (1.0 - pu);
+        p[0] = up;
+        p[1] = (ermqdt - pu * up) / (1.0 - pu);
+        p[2] = pu;
+    }
 
-        return x0_ * std::pow(down, Real(BigInteger(i)-BigInteger(index)))
-            * std::pow(up, Real(index));
+    Real ExtendedLeisenReimer_2::underlying(Size i, Size index) const {
+        const StepParameters& p = step(i);
+        return x0_ * std::pow(p[1], Real(BigInteger(i)-BigInteger(index)))
+            * std::pow(p[0], Real(index));
     }
 
     Real ExtendedLeisenReimer_2::probability(Size i, Size, Size branch) const {
-        Time stepTime = i*this->dt_;
-        Real variance = this->treeProcess_->variance(stepTime, x0_, end_);
-        Real d2 = (std::log(x0_/strike_) + this->driftStep(stepTime)*oddSteps_ ) /
-            std::sqrt(variance);
-
-        Real pu = PeizerPrattMethod2Inversion(d2, oddSteps_);
+        Real pu = step(i)[2];
         Real pd = 1.0 - pu;
 
         return (branch == 1 ? pu : pd);
@@ -253,8 +253,8 @@ namespace QuantLib {
         down_ = (ermqdt - pu_ * up_) / (1.0 - pu_);
     }
 
-    Real ExtendedJoshi4_2::underlying(Size i, Size index) const {
-        Time stepTime = i*this->dt_;
+    void ExtendedJoshi4_2::computeStep(Time stepTime,
+                                       StepParameters& p) const {
         Real variance = this->treeProcess_->variance(stepTime, x0_, end_);
         Real ermqdt = std::exp(this->driftStep(stepTime) + 0.5*variance/oddSteps_);
         Real d2 = (std::log(x0_/strike_) + this->driftStep(stepTime)*oddSteps_ ) /
@@ -263,19 +263,19 @@ namespace QuantLib {
         Real pu = computeUpProb((oddSteps_-1.0)/2.0,d2 );
         Real pdash = computeUpProb((oddSteps_-1.0)/2.0,d2+std::sqrt(variance));
         Real up = ermqdt * pdash / pu;
-        Real down = (ermqdt - pu * up) / (1.0 - pu);
+        p[0] = up;
+        p[1] = (ermqdt - pu * up) / (1.0 - pu);
+        p[2] = pu;
+    }
 
-        return x0_ * std::pow(down, Real(BigInteger(i)-BigInteger(index)))
-            * std::pow(up, Real(index));
+    Real ExtendedJoshi4_2::underlying(Size i, Size index) const {
+        const StepParameters& p = step(i);
+        return x0_ * std::pow(p[1], Real(BigInteger(i)-BigInteger(index)))
+            * std::pow(p[0], Real(index));
     }
 
     Real ExtendedJoshi4_2::probability(Size i, Size, Size branch) const {
-        Time stepTime = i*this->dt_;
-        Real variance = this->treeProcess_->variance(stepTime, x0_, end_);
-        Real d2 = (std::log(x0_/strike_) + this->driftStep(stepTime)*oddSteps_ ) /
-            std::sqrt(variance);
-
-        Real pu = computeUpProb((oddSteps_-1.0)/2.0,d2 );
+        Real pu = step(i)[2];
         Real pd = 1.0 - pu;
 
         return (branch == 1 ? pu : pd);
@@ -30,6 +30,10 @@
 #include <ql/methods/lattices/tree.hpp>
 #include <ql/instruments/dividendschedule.hpp>
 #include <ql/stochasticprocess.hpp>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace QuantLib {
 
@@ -43,11 +47,13 @@ namespace QuantLib {
                         const boost::shared_ptr<StochasticProcess1D>& process,
                         Time end,
                         Size steps)
-        : Tree<T>(steps+1), treeProcess_(process) {
+        : Tree<T>(steps+1), treeProcess_(process),
+          parameters_(steps+1), computed_(new std::once_flag[steps+1]) {
             x0_ = process->x0();
             dt_ = end/steps;
             driftPerStep_ = process->drift(0.0, x0_) * dt_;
         }
+        virtual ~ExtendedBinomialTree_2() {}
         Size size(Size i) const {
             return i+1;
         }
@@ -55,6 +61,23 @@ namespace QuantLib {
             return index + branch;
         }
       protected:
+        //! parameters of a time step; their meaning depends on the tree
+        typedef std::array<Real,3> StepParameters;
+        /*! The parameters of step i are computed by computeStep()
+            on first access and stored, so that further node access
+            doesn't query the process; steps that are never visited
+            cost nothing.  Each step is filled under std::call_once,
+            so that the tree can be shared by concurrent rollbacks.
+        */
+        const StepParameters& step(Size i) const {
+            std::call_once(computed_[i], [this, i]() {
+                this->computeStep(i*this->dt_, this->parameters_[i]);
+            });
+            return parameters_[i];
+        }
+        virtual void computeStep(Time stepTime,
+                                 StepParameters& parameters) const = 0;
+
         //time dependent drift per step
         Real driftStep(Time driftTime) const {
             return this->treeProcess_->drift(driftTime, x0_) * dt_;
@@ -65,6 +88,9 @@ namespace QuantLib {
 
       protected:
         boost::shared_ptr<StochasticProcess1D> treeProcess_;
+      private:
+        mutable std::vector<StepParameters> parameters_;
+        std::unique_ptr<std::once_flag[]> computed_;
     };
 
 
@@ -82,16 +108,24 @@ namespace QuantLib {
         virtual ~ExtendedEqualProbabilitiesBinomialTree_2() {}
 
         Real underlying(Size i, Size index) const {
-            Time stepTime = i*this->dt_;
+            const typename ExtendedBinomialTree_2<T>::StepParameters& p =
+                this->step(i);
             BigInteger j = 2*BigInteger(index) - BigInteger(i);
             // exploiting the forward value tree centering
-            return this->x0_*std::exp(i*this->driftStep(stepTime) + j*this->upStep(stepTime));
+            return this->x0_*std::exp(i*p[0] + j*p[1]);
         }
 
         Real probability(Size, Size, Size) const { return 0.5; }
       protected:
         //the tree dependent up move term at time stepTime
         virtual Real upStep(Time stepTime) const = 0;
+        // drift and up move
+        void computeStep(
+                  Time stepTime,
+                  typename ExtendedBinomialTree_2<T>::StepParameters& p) const {
+            p[0] = this->driftStep(stepTime);
+            p[1] = this->upStep(stepTime);
+        }
         Real up_;
     };
 
@@ -109,15 +143,14 @@ namespace QuantLib {
         virtual ~ExtendedEqualJumpsBinomialTree_2() {}
 
         Real underlying(Size i, Size index) const {
-            Time stepTime = i*this->dt_;
+            Real dx = this->step(i)[0];
             BigInteger j = 2*BigInteger(index) - BigInteger(i);
             // exploiting equal jump and the x0_ tree centering
-            return this->x0_*std::exp(j*this->dxStep(stepTime));
+            return this->x0_*std::exp(j*dx);
         }
 
         Real probability(Size i, Size, Size branch) const {
-            Time stepTime = i*this->dt_;
-            Real upProb = this->probUp(stepTime);
+            Real upProb = this->step(i)[1];
             Real downProb = 1 - upProb;
             return (branch == 1 ? upProb : downProb);
         }
@@ -126,6 +159,13 @@ namespace QuantLib {
         virtual Real probUp(Time stepTime) const = 0;
         //time dependent term dx_
         virtual Real dxStep(Time stepTime) const = 0;
+        // dx and up probability
+        void computeStep(
+                  Time stepTime,
+                  typename ExtendedBinomialTree_2<T>::StepParameters& p) const {
+            p[0] = this->dxStep(stepTime);
+            p[1] = this->probUp(stepTime);
+        }
 
         Real dx_, pu_, pd_;
     };
@@ -205,6 +245,8 @@ namespace QuantLib {
         Real underlying(Size i, Size index) const;
         Real probability(Size, Size, Size branch) const;
       protected:
+        // up, down and up probability
+        void computeStep(Time stepTime, StepParameters& p) const;
         Real up_, down_, pu_, pd_;
     };
 
@@ -221,6 +263,8 @@ namespace QuantLib {
         Real underlying(Size i, Size index) const;
         Real probability(Size, Size, Size branch) const;
       protected:
+        // up, down and up probability
+        void computeStep(Time stepTime, StepParameters& p) const;
         Time end_;
         Size oddSteps_;
         Real strike_, up_, down_, pu_, pd_;
@@ -238,6 +282,8 @@ namespace QuantLib {
         Real probability(Size, Size, Size branch) const;
       protected:
         Real computeUpProb(Real k, Real dj) const;
+        // up, down and up probability
+        void computeStep(Time stepTime, StepParameters& p) const;
         Time end_;
         Size oddSteps_;
         Real strike_, up_, down_, pu_, pd_;
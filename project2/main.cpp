@@ -3,6 +3,8 @@
 #include "binomialengine.hpp"
 #include <ql/pricingengines/vanilla/binomialengine.hpp>
 #include <ql/experimental/lattices/extendedbinomialtree.hpp>
+#include <ql/methods/lattices/bsmlattice.hpp>
+#include <ql/pricingengines/vanilla/discretizedvanillaoption.hpp>
 #include <ql/instruments/vanillaoption.hpp>
 #include <ql/instruments/payoffs.hpp>
 #include <ql/exercise.hpp>
@@ -12,9 +14,84 @@
 #include <ql/utilities/dataformatters.hpp>
 #include <iostream>
 #include <chrono>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace QuantLib;
 
+namespace {
+
+    // rolls back the option on a lattice built on the given tree
+    template <class T>
+    Real rollback(const ext::shared_ptr<T>& tree,
+                  const VanillaOption::arguments& arguments,
+                  const StochasticProcess& process,
+                  Rate riskFreeRate, Time maturity, Size steps) {
+        ext::shared_ptr<BlackScholesLattice<T> > lattice(
+            new BlackScholesLattice<T>(tree, riskFreeRate, maturity, steps));
+        DiscretizedVanillaOption option(arguments, process,
+                                        TimeGrid(maturity, steps));
+        option.initialize(lattice, maturity);
+        option.rollback(0.0);
+        return option.presentValue();
+    }
+
+    /* The steps of an extended tree are computed on first access;
+       a tree shared by several threads, each rolling back its own
+       lattice, must give the same price as a tree used serially. */
+    template <class T>
+    void checkSharedTree(const std::string& name,
+                         const VanillaOption& option,
+                         const ext::shared_ptr<BlackScholesProcess>& process,
+                         Size steps) {
+        VanillaOption::arguments arguments;
+        option.setupArguments(&arguments);
+        Date maturityDate = arguments.exercise->lastDate();
+        DayCounter dayCounter = process->riskFreeRate()->dayCounter();
+        Rate r = process->riskFreeRate()->zeroRate(maturityDate, dayCounter,
+                                                   Continuous, NoFrequency);
+        Time maturity = process->time(maturityDate);
+        Real strike = ext::dynamic_pointer_cast<StrikedTypePayoff>(
+                                                 arguments.payoff)->strike();
+
+        // the serial run also sets up the lazy parts of the process,
+        // which are not meant to be shared before that
+        Real serialNPV = rollback(
+            ext::make_shared<T>(process, maturity, steps, strike),
+            arguments, *process, r, maturity, steps);
+
+        ext::shared_ptr<T> tree =
+            ext::make_shared<T>(process, maturity, steps, strike);
+        const Size nThreads = 4;
+        std::vector<Real> NPVs(nThreads);
+        std::vector<std::exception_ptr> errors(nThreads);
+        std::vector<std::thread> threads;
+        for (Size k=0; k<nThreads; ++k) {
+            threads.emplace_back([&, k]() {
+                try {
+                    NPVs[k] = rollback(tree, arguments, *process,
+                                       r, maturity, steps);
+                } catch (...) {
+                    errors[k] = std::current_exception();
+                }
+            });
+        }
+        for (Size k=0; k<nThreads; ++k)
+            threads[k].join();
+        for (Size k=0; k<nThreads; ++k) {
+            if (errors[k])
+                std::rethrow_exception(errors[k]);
+            QL_REQUIRE(NPVs[k] == serialNPV,
+                       name << " tree shared by " << nThreads
+                       << " threads: " << NPVs[k] << " vs "
+                       << serialNPV << " when used serially");
+        }
+    }
+
+}
+
 int main() {
 
     try {
@@ -65,6 +142,14 @@ int main() {
         std::cout << "NPV: " << NPV << std::endl;
         std::cout << "Elapsed time: " << us / 1000000 << " s" << std::endl;
 
+        checkSharedTree<ExtendedJarrowRudd_2>(
+            "Jarrow-Rudd", americanOption, bsmProcess, timeSteps);
+        checkSharedTree<ExtendedTian_2>(
+            "Tian", americanOption, bsmProcess, timeSteps);
+        checkSharedTree<ExtendedJoshi4_2>(
+            "Joshi", americanOption, bsmProcess, timeSteps);
+        std::cout << "Shared trees checked" << std::endl;
+
         return 0;
 
     } catch (std::exception& e) {
@@ -44,11 +44,17 @@ namespace QuantLib {
         \test the correctness of the returned values is tested by
               checking it against analytic results.
 
-        \todo Greeks are not overly accurate. They could be improved
-              by building a tree so that it has three points at the
-              current time. The value would be fetched from the middle
-              one, while the two side points would be used for
-              estimating partial derivatives.
+        The tree and the lattice are reused by later calculations
+        in which only the underlying value changed; T must provide
+        the rescalable flag and the rescale() method of the trees
+        in binomialtree.hpp.
+
+        If the tree has three nodes at the current time, as
+        ThreeNodesBinomialTree_2 does, delta and gamma are taken
+        from them and theta from the middle node two steps later.
+        Otherwise, delta and gamma are estimated at the first steps
+        of the tree and theta is derived from the Black-Scholes
+        equation; these Greeks are not overly accurate.
     */
     template <class T>
     class BinomialVanillaEngine_2 : public VanillaOption::engine {
@@ -61,11 +67,33 @@ namespace QuantLib {
                        "at least 2 time steps required, "
                        << timeSteps << " provided");
             registerWith(process_);
+            termStructures_.registerWith(process_->riskFreeRate());
+            termStructures_.registerWith(process_->dividendYield());
+            termStructures_.registerWith(process_->blackVolatility());
         }
         void calculate() const;
       private:
+        //! records changes of the term structures of the process
+        class ChangeFlag : public Observer {
+          public:
+            ChangeFlag() : changed_(true) {}
+            void update() { changed_ = true; }
+            bool changed_;
+        };
         boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
         Size timeSteps_;
+        /* The tree and the lattice are kept across calculations and
+           rebuilt only when the term structures, the volatility at
+           the spot, the maturity or the strike change; if only the
+           spot moved, the nodes of the tree are rescaled when T
+           allows it. */
+        mutable ChangeFlag termStructures_;
+        mutable boost::shared_ptr<T> tree_;
+        mutable boost::shared_ptr<BlackScholesLattice<T> > lattice_;
+        mutable Real s0_, strike_;
+        mutable Volatility v_;
+        mutable Date maturityDate_;
+        mutable Time maturity_;
     };
 
 
@@ -74,58 +102,117 @@ namespace QuantLib {
     template <class T>
     void BinomialVanillaEngine_2<T>::calculate() const {
 
-        DayCounter rfdc  = process_->riskFreeRate()->dayCounter();
-        DayCounter divdc = process_->dividendYield()->dayCounter();
-        DayCounter voldc = process_->blackVolatility()->dayCounter();
-        Calendar volcal = process_->blackVolatility()->calendar();
-
         Real s0 = process_->stateVariable()->value();
         QL_REQUIRE(s0 > 0.0, "negative or null underlying given");
-        Volatility v = process_->blackVolatility()->blackVol(
-            arguments_.exercise->lastDate(), s0);
         Date maturityDate = arguments_.exercise->lastDate();
-        Rate r = process_->riskFreeRate()->zeroRate(maturityDate,
-            rfdc, Continuous, NoFrequency);
-        Rate q = process_->dividendYield()->zeroRate(maturityDate,
-            divdc, Continuous, NoFrequency);
-        Date referenceDate = process_->riskFreeRate()->referenceDate();
-
-        // binomial trees with constant coefficient
-        Handle<YieldTermStructure> flatRiskFree(
-            boost::shared_ptr<YieldTermStructure>(
-                new FlatForward(referenceDate, r, rfdc)));
-        Handle<YieldTermStructure> flatDividends(
-            boost::shared_ptr<YieldTermStructure>(
-                new FlatForward(referenceDate, q, divdc)));
-        Handle<BlackVolTermStructure> flatVol(
-            boost::shared_ptr<BlackVolTermStructure>(
-                new BlackConstantVol(referenceDate, volcal, v, voldc)));
+        Volatility v = process_->blackVolatility()->blackVol(maturityDate, s0);
 
         boost::shared_ptr<PlainVanillaPayoff> payoff =
             boost::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
         QL_REQUIRE(payoff, "non-plain payoff given");
 
-        Time maturity = rfdc.yearFraction(referenceDate, maturityDate);
-
-        boost::shared_ptr<StochasticProcess1D> bs(
-                         new GeneralizedBlackScholesProcess(
-                                      process_->stateVariable(),
-                                      flatDividends, flatRiskFree, flatVol));
+        if (!tree_ || termStructures_.changed_ || v != v_ ||
+            maturityDate != maturityDate_ || payoff->strike() != strike_ ||
+            (s0 != s0_ && !T::rescalable)) {
+
+            DayCounter rfdc  = process_->riskFreeRate()->dayCounter();
+            DayCounter divdc = process_->dividendYield()->dayCounter();
+            DayCounter voldc = process_->blackVolatility()->dayCounter();
+            Calendar volcal = process_->blackVolatility()->calendar();
+
+            Rate r = process_->riskFreeRate()->zeroRate(maturityDate,
+                rfdc, Continuous, NoFrequency);
+            Rate q = process_->dividendYield()->zeroRate(maturityDate,
+                divdc, Continuous, NoFrequency);
+            Date referenceDate = process_->riskFreeRate()->referenceDate();
+
+            // binomial trees with constant coefficient
+            Handle<YieldTermStructure> flatRiskFree(
+                boost::shared_ptr<YieldTermStructure>(
+                    new FlatForward(referenceDate, r, rfdc)));
+            Handle<YieldTermStructure> flatDividends(
+                boost::shared_ptr<YieldTermStructure>(
+                    new FlatForward(referenceDate, q, divdc)));
+            Handle<BlackVolTermStructure> flatVol(
+                boost::shared_ptr<BlackVolTermStructure>(
+                    new BlackConstantVol(referenceDate, volcal, v, voldc)));
+
+            Time maturity = rfdc.yearFraction(referenceDate, maturityDate);
+
+            boost::shared_ptr<StochasticProcess1D> bs(
+                             new GeneralizedBlackScholesProcess(
+                                          process_->stateVariable(),
+                                          flatDividends, flatRiskFree, flatVol));
+
+            tree_ = boost::shared_ptr<T>(new T(bs, maturity, timeSteps_,
+                                               payoff->strike()));
+            lattice_ = boost::shared_ptr<BlackScholesLattice<T> >(
+                new BlackScholesLattice<T>(tree_, r, maturity, timeSteps_));
+
+            termStructures_.changed_ = false;
+            v_ = v;
+            maturityDate_ = maturityDate;
+            maturity_ = maturity;
+            strike_ = payoff->strike();
+        } else if (s0 != s0_) {
+            // the lattice reads the nodes from the tree
+            tree_->rescale(s0/s0_);
+        }
+        s0_ = s0;
 
+        Time maturity = maturity_;
         TimeGrid grid(maturity, timeSteps_);
-
-        boost::shared_ptr<T> tree(new T(bs, maturity, timeSteps_,
-                                        payoff->strike()));
-
-        boost::shared_ptr<BlackScholesLattice<T> > lattice(
-            new BlackScholesLattice<T>(tree, r, maturity, timeSteps_));
+        boost::shared_ptr<BlackScholesLattice<T> > lattice = lattice_;
 
         DiscretizedVanillaOption option(arguments_, *process_, grid);
 
         option.initialize(lattice, maturity);
 
+        if (lattice->size(0) == 3) {
+            // three nodes at t=0 (see ThreeNodesBinomialTree_2)
+
+            // Rollback to the second step and get the value at the
+            // middle node, used for theta
+            option.rollback(grid[2]);
+            Array va2(option.values());
+            QL_ENSURE(va2.size() == 5, "Expect 5 nodes in grid at second step");
+            Real p2m = va2[2];
+            Real s2m = lattice->underlying(2, 2);
+
+            option.rollback(0.0);
+            Array va0(option.values());
+            QL_ENSURE(va0.size() == 3, "Expect 3 nodes in grid at t=0");
+            Real p0u = va0[2]; // up
+            Real p0m = va0[1]; // mid
+            Real p0d = va0[0]; // down (low)
+            Real s0u = lattice->underlying(0, 2); // up price
+            Real s0m = lattice->underlying(0, 1); // middle price, i.e., s0
+            Real s0d = lattice->underlying(0, 0); // down (low) price
+
+            // the nodes are not evenly spaced, so the two one-sided
+            // deltas are weighted to get a second-order estimate
+            Real hu = s0u - s0m, hd = s0m - s0d;
+            Real delta0u = (p0u - p0m)/hu;
+            Real delta0d = (p0m - p0d)/hd;
+            Real delta = (hd*delta0u + hu*delta0d)/(hu + hd);
+            Real gamma = (delta0u - delta0d) / ((hu + hd)/2);
+
+            // the middle node at the second step is not at s0 for
+            // all trees; its value is brought back to s0 before
+            // taking the time derivative
+            Real ds = s2m - s0m;
+            Real theta = (p2m - delta*ds - 0.5*gamma*ds*ds - p0m) / grid[2];
+
+            // Store results
+            results_.value = p0m;
+            results_.delta = delta;
+            results_.gamma = gamma;
+            results_.theta = theta;
+            return;
+        }
+
         // Partial derivatives calculated from various points in the
-        // binomial tree 
+        // binomial tree
         // (see J.C.Hull, "Options, Futures and other derivatives", 6th edition, pp 397/398)
 
         // Rollback to third-last step, and get underlying prices (s2) &
@@ -0,0 +1,213 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file binomialportfolio.hpp
+    \brief Binomial pricing of many vanilla options on one tree
+*/
+
+#ifndef binomial_portfolio_hpp
+#define binomial_portfolio_hpp
+
+#include "binomialrollback.hpp"
+#include <ql/exercise.hpp>
+#include <ql/instruments/payoffs.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include <ql/termstructures/yield/flatforward.hpp>
+#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include <ql/timegrid.hpp>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Binomial pricer for a portfolio of vanilla options
+    /*! All the options must share the underlying and the exercise;
+        they can differ in strike and type.  The tree is built once,
+        with the same market data as BinomialVanillaEngine_2 (whose
+        volatility doesn't depend on the strike) and all the payoffs
+        are rolled back together: at each step, the underlying
+        values of the nodes are computed once and shared by the
+        early-exercise conditions of all the options.  Each option
+        is rolled back by the kernel in binomialrollback.hpp, so the
+        results are the same as FlatBinomialVanillaEngine_2's.
+
+        \pre The geometry of the tree must not depend on the strike
+             passed to its constructor; this holds for JarrowRudd_2,
+             CoxRossRubinstein_2, AdditiveEQPBinomialTree_2,
+             Trigeorgis_2 and Tian_2, but not for LeisenReimer_2 or
+             Joshi4_2.
+    */
+    template <class T>
+    class BinomialVanillaPortfolio_2 {
+      public:
+        BinomialVanillaPortfolio_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const std::vector<boost::shared_ptr<PlainVanillaPayoff> >& payoffs,
+             const boost::shared_ptr<Exercise>& exercise,
+             Size timeSteps);
+        void calculate();
+        //! \name Results
+        //@{
+        const std::vector<Real>& NPV() const { return values_; }
+        const std::vector<Real>& delta() const { return deltas_; }
+        const std::vector<Real>& gamma() const { return gammas_; }
+        //@}
+      private:
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        boost::shared_ptr<Exercise> exercise_;
+        Size timeSteps_;
+        std::vector<Real> strikes_, omegas_;
+        std::vector<Real> values_, deltas_, gammas_;
+    };
+
+
+    // template definitions
+
+    template <class T>
+    BinomialVanillaPortfolio_2<T>::BinomialVanillaPortfolio_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const std::vector<boost::shared_ptr<PlainVanillaPayoff> >& payoffs,
+             const boost::shared_ptr<Exercise>& exercise,
+             Size timeSteps)
+    : process_(process), exercise_(exercise), timeSteps_(timeSteps) {
+        QL_REQUIRE(!payoffs.empty(), "no payoffs given");
+        QL_REQUIRE(timeSteps >= 2,
+                   "at least 2 time steps required, "
+                   << timeSteps << " provided");
+        QL_REQUIRE(exercise->type() == Exercise::European ||
+                   exercise->type() == Exercise::American,
+                   "only European and American exercise supported");
+        for (Size o=0; o<payoffs.size(); ++o) {
+            strikes_.push_back(payoffs[o]->strike());
+            omegas_.push_back(
+                payoffs[o]->optionType() == Option::Call ? 1.0 : -1.0);
+        }
+    }
+
+    template <class T>
+    void BinomialVanillaPortfolio_2<T>::calculate() {
+
+        DayCounter rfdc  = process_->riskFreeRate()->dayCounter();
+        DayCounter divdc = process_->dividendYield()->dayCounter();
+        DayCounter voldc = process_->blackVolatility()->dayCounter();
+        Calendar volcal = process_->blackVolatility()->calendar();
+
+        Real s0 = process_->stateVariable()->value();
+        QL_REQUIRE(s0 > 0.0, "negative or null underlying given");
+        Date maturityDate = exercise_->lastDate();
+        Volatility v = process_->blackVolatility()->blackVol(maturityDate, s0);
+        Rate r = process_->riskFreeRate()->zeroRate(maturityDate,
+            rfdc, Continuous, NoFrequency);
+        Rate q = process_->dividendYield()->zeroRate(maturityDate,
+            divdc, Continuous, NoFrequency);
+        Date referenceDate = process_->riskFreeRate()->referenceDate();
+
+        // binomial trees with constant coefficient
+        Handle<YieldTermStructure> flatRiskFree(
+            boost::shared_ptr<YieldTermStructure>(
+                new FlatForward(referenceDate, r, rfdc)));
+        Handle<YieldTermStructure> flatDividends(
+            boost::shared_ptr<YieldTermStructure>(
+                new FlatForward(referenceDate, q, divdc)));
+        Handle<BlackVolTermStructure> flatVol(
+            boost::shared_ptr<BlackVolTermStructure>(
+                new BlackConstantVol(referenceDate, volcal, v, voldc)));
+
+        Time maturity = rfdc.yearFraction(referenceDate, maturityDate);
+
+        boost::shared_ptr<StochasticProcess1D> bs(
+                         new GeneralizedBlackScholesProcess(
+                                      process_->stateVariable(),
+                                      flatDividends, flatRiskFree, flatVol));
+
+        TimeGrid grid(maturity, timeSteps_);
+
+        // the strike is passed for the sake of the interface only
+        boost::shared_ptr<T> tree(new T(bs, maturity, timeSteps_,
+                                        strikes_.front()));
+        QL_REQUIRE(tree->size(0) == 1,
+                   "trees with more than one node at t=0 not supported");
+
+        Real pu = tree->probability(0, 0, 1);
+        Real pd = tree->probability(0, 0, 0);
+        DiscountFactor discount = std::exp(-r*(maturity/timeSteps_));
+
+        bool american = exercise_->type() == Exercise::American;
+        Time exerciseStart = 0.0, exerciseEnd = 0.0;
+        if (american) {
+            exerciseStart = process_->time(exercise_->date(0));
+            exerciseEnd = process_->time(exercise_->lastDate());
+        }
+
+        Size n = timeSteps_, m = strikes_.size();
+        std::vector<Real> underlying(n+1), exercise(n+1);
+        std::vector<std::vector<Real> > values(m, std::vector<Real>(n+1));
+        for (Size j=0; j<=n; ++j)
+            underlying[j] = tree->underlying(n, j);
+        for (Size o=0; o<m; ++o) {
+            Real strike = strikes_[o], omega = omegas_[o];
+            for (Size j=0; j<=n; ++j)
+                values[o][j] = std::max(omega*(underlying[j] - strike), 0.0);
+        }
+
+        std::vector<Real> p2u(m), p2m(m), p2d(m), p1u(m), p1d(m);
+        // with two steps, the rollback starts at step 2
+        if (n == 2) {
+            for (Size o=0; o<m; ++o) {
+                p2d[o] = values[o][0];
+                p2m[o] = values[o][1];
+                p2u[o] = values[o][2];
+            }
+        }
+        for (Size i=n; i>0; --i) {
+            Size k = i-1;
+            Time t = grid[k];
+            if (american && t >= exerciseStart && t <= exerciseEnd) {
+                for (Size j=0; j<=k; ++j)
+                    underlying[j] = tree->underlying(k, j);
+                for (Size o=0; o<m; ++o) {
+                    Real strike = strikes_[o], omega = omegas_[o];
+                    for (Size j=0; j<=k; ++j)
+                        exercise[j] =
+                            std::max(omega*(underlying[j] - strike), 0.0);
+                    detail::binomialRollback(&values[o][0], &exercise[0], k+1,
+                                             pu, pd, discount);
+                }
+            } else {
+                for (Size o=0; o<m; ++o)
+                    detail::binomialRollback(&values[o][0], 0, k+1,
+                                             pu, pd, discount);
+            }
+            for (Size o=0; o<m; ++o) {
+                if (k == 2) {
+                    p2d[o] = values[o][0];
+                    p2m[o] = values[o][1];
+                    p2u[o] = values[o][2];
+                } else if (k == 1) {
+                    p1d[o] = values[o][0];
+                    p1u[o] = values[o][1];
+                }
+            }
+        }
+
+        // same estimates as BinomialVanillaEngine_2
+        Real s2u = tree->underlying(2, 2);
+        Real s2m = tree->underlying(2, 1);
+        Real s2d = tree->underlying(2, 0);
+        Real s1u = tree->underlying(1, 1);
+        Real s1d = tree->underlying(1, 0);
+
+        values_.resize(m);
+        deltas_.resize(m);
+        gammas_.resize(m);
+        for (Size o=0; o<m; ++o) {
+            Real delta2u = (p2u[o] - p2m[o])/(s2u-s2m);
+            Real delta2d = (p2m[o]-p2d[o])/(s2m-s2d);
+            values_[o] = values[o][0];
+            deltas_[o] = (p1u[o] - p1d[o]) / (s1u - s1d);
+            gammas_[o] = (delta2u - delta2d) / ((s2u-s2d)/2);
+        }
+    }
+
+}
+
+
+#endif
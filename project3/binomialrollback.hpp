@@ -0,0 +1,164 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file binomialrollback.hpp
+    \brief Vectorized rollback kernel for binomial trees
+*/
+
+#ifndef binomial_rollback_hpp
+#define binomial_rollback_hpp
+
+#include <ql/types.hpp>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BINOMIAL_ROLLBACK_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/* Contraction of multiplications and additions into fused
+   multiply-adds would change the results of the kernels depending on
+   the instruction set (avx512f implies fma); it's disabled so that
+   all kernels give the same results. */
+#if defined(__GNUC__) && !defined(__clang__)
+#define BINOMIAL_ROLLBACK_NO_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+#define BINOMIAL_ROLLBACK_NO_CONTRACT
+#endif
+
+namespace QuantLib {
+
+    namespace detail {
+
+        /*! Signature of the rollback kernels.  The first n values
+            are replaced in place by
+
+                values[j] = (pd*values[j] + pu*values[j+1])*discount
+
+            followed, if exercise is not null, by
+
+                values[j] = std::max(values[j], exercise[j]);
+
+            values must hold n+1 elements and exercise n elements.
+        */
+        typedef void (*binomial_rollback_kernel)(Real* values,
+                                                 const Real* exercise,
+                                                 Size n,
+                                                 Real pu,
+                                                 Real pd,
+                                                 DiscountFactor discount);
+
+        BINOMIAL_ROLLBACK_NO_CONTRACT
+        inline void binomialRollbackScalar(Real* values,
+                                           const Real* exercise,
+                                           Size n,
+                                           Real pu,
+                                           Real pd,
+                                           DiscountFactor discount) {
+            if (exercise != 0) {
+                for (Size j=0; j<n; ++j)
+                    values[j] = std::max(
+                        (pd*values[j] + pu*values[j+1])*discount,
+                        exercise[j]);
+            } else {
+                for (Size j=0; j<n; ++j)
+                    values[j] = (pd*values[j] + pu*values[j+1])*discount;
+            }
+        }
+
+        #if defined(BINOMIAL_ROLLBACK_X86_DISPATCH)
+
+        /* The vector kernels perform the same operations in the same
+           order as the scalar one, with separate multiplications and
+           additions, so their results are bit-identical.  Within
+           each block, values[j+1..] are loaded before values[j..] is
+           stored, so the update can be done in place.  The max is
+           taken as max(exercise, continuation), which returns the
+           continuation value for ties and NaNs, as
+           std::max(continuation, exercise) does.
+        */
+
+        __attribute__((target("avx2"))) BINOMIAL_ROLLBACK_NO_CONTRACT
+        inline void binomialRollbackAvx2(Real* values,
+                                         const Real* exercise,
+                                         Size n,
+                                         Real pu,
+                                         Real pd,
+                                         DiscountFactor discount) {
+            __m256d vpu = _mm256_set1_pd(pu);
+            __m256d vpd = _mm256_set1_pd(pd);
+            __m256d vdiscount = _mm256_set1_pd(discount);
+            Size j = 0;
+            for (; j+4<=n; j+=4) {
+                __m256d down = _mm256_loadu_pd(values+j);
+                __m256d up = _mm256_loadu_pd(values+j+1);
+                __m256d v = _mm256_mul_pd(
+                    _mm256_add_pd(_mm256_mul_pd(vpd, down),
+                                  _mm256_mul_pd(vpu, up)),
+                    vdiscount);
+                if (exercise != 0)
+                    v = _mm256_max_pd(_mm256_loadu_pd(exercise+j), v);
+                _mm256_storeu_pd(values+j, v);
+            }
+            binomialRollbackScalar(values+j, exercise != 0 ? exercise+j : 0,
+                                   n-j, pu, pd, discount);
+        }
+
+        __attribute__((target("avx512f"))) BINOMIAL_ROLLBACK_NO_CONTRACT
+        inline void binomialRollbackAvx512(Real* values,
+                                           const Real* exercise,
+                                           Size n,
+                                           Real pu,
+                                           Real pd,
+                                           DiscountFactor discount) {
+            __m512d vpu = _mm512_set1_pd(pu);
+            __m512d vpd = _mm512_set1_pd(pd);
+            __m512d vdiscount = _mm512_set1_pd(discount);
+            Size j = 0;
+            for (; j+8<=n; j+=8) {
+                __m512d down = _mm512_loadu_pd(values+j);
+                __m512d up = _mm512_loadu_pd(values+j+1);
+                __m512d v = _mm512_mul_pd(
+                    _mm512_add_pd(_mm512_mul_pd(vpd, down),
+                                  _mm512_mul_pd(vpu, up)),
+                    vdiscount);
+                if (exercise != 0)
+                    v = _mm512_max_pd(_mm512_loadu_pd(exercise+j), v);
+                _mm512_storeu_pd(values+j, v);
+            }
+            binomialRollbackScalar(values+j, exercise != 0 ? exercise+j : 0,
+                                   n-j, pu, pd, discount);
+        }
+
+        #endif
+
+        //! selects the fastest kernel supported by the running CPU
+        inline binomial_rollback_kernel selectBinomialRollbackKernel() {
+            #if defined(BINOMIAL_ROLLBACK_X86_DISPATCH)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f"))
+                return &binomialRollbackAvx512;
+            if (__builtin_cpu_supports("avx2"))
+                return &binomialRollbackAvx2;
+            #endif
+            return &binomialRollbackScalar;
+        }
+
+        //! rolls back one step of a binomial tree in place
+        /*! The kernel is selected once, at the first call. */
+        inline void binomialRollback(Real* values,
+                                     const Real* exercise,
+                                     Size n,
+                                     Real pu,
+                                     Real pd,
+                                     DiscountFactor discount) {
+            static const binomial_rollback_kernel kernel =
+                selectBinomialRollbackKernel();
+            kernel(values, exercise, n, pu, pd, discount);
+        }
+
+    }
+
+}
+
+
+#endif
@@ -31,6 +31,7 @@ namespace QuantLib {
     : EqualProbabilitiesBinomialTree_2<JarrowRudd_2>(process, end, steps) {
         // drift removed
         up_ = process->stdDeviation(0.0, x0_, dt_);
+        initializeNodes();
     }
 
 
@@ -45,6 +46,7 @@ namespace QuantLib {
 
         QL_REQUIRE(pu_<=1.0, "negative probability");
         QL_REQUIRE(pu_>=0.0, "negative probability");
+        initializeNodes();
     }
 
 
@@ -56,6 +58,7 @@ namespace QuantLib {
         up_ = - 0.5 * driftPerStep_ + 0.5 *
             std::sqrt(4.0*process->variance(0.0, x0_, dt_)-
                       3.0*driftPerStep_*driftPerStep_);
+        initializeNodes();
     }
 
 
@@ -71,6 +74,7 @@ namespace QuantLib {
 
         QL_REQUIRE(pu_<=1.0, "negative probability");
         QL_REQUIRE(pu_>=0.0, "negative probability");
+        initializeNodes();
     }
 
 
@@ -93,6 +97,9 @@ namespace QuantLib {
 
         QL_REQUIRE(pu_<=1.0, "negative probability");
         QL_REQUIRE(pu_>=0.0, "negative probability");
+
+        upPowers_ = powers(up_);
+        downPowers_ = powers(down_);
     }
 
 
@@ -114,6 +121,8 @@ namespace QuantLib {
         up_ = ermqdt * pdash / pu_;
         down_ = (ermqdt - pu_ * up_) / (1.0 - pu_);
 
+        upPowers_ = powers(up_);
+        downPowers_ = powers(down_);
     }
 
     Real Joshi4_2::computeUpProb(Real k, Real dj) const {
@@ -152,6 +161,9 @@ namespace QuantLib {
         Real pdash = computeUpProb((oddSteps-1.0)/2.0,d2+std::sqrt(variance));
         up_ = ermqdt * pdash / pu_;
         down_ = (ermqdt - pu_ * up_) / (1.0 - pu_);
+
+        upPowers_ = powers(up_);
+        downPowers_ = powers(down_);
     }
 
 }
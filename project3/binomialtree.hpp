@@ -29,6 +29,7 @@
 #include <ql/methods/lattices/tree.hpp>
 #include <ql/instruments/dividendschedule.hpp>
 #include <ql/stochasticprocess.hpp>
+#include <vector>
 
 namespace QuantLib {
 
@@ -38,6 +39,11 @@ namespace QuantLib {
     class BinomialTree_2 : public Tree<T> {
       public:
         enum Branches { branches = 2 };
+        /*! whether the tree built for a different x0 is the same
+            tree with all node values rescaled; derived classes
+            whose geometry depends on x0 must redefine it as false.
+        */
+        enum { rescalable = true };
         BinomialTree_2(const boost::shared_ptr<StochasticProcess1D>& process,
                        Time end,
                        Size steps)
@@ -52,7 +58,18 @@ namespace QuantLib {
         Size descendant(Size, Size index, Size branch) const {
             return index + branch;
         }
+        //! multiplies the values of all the nodes by the given factor
+        void rescale(Real factor) {
+            x0_ *= factor;
+        }
       protected:
+        //! powers of the given factor, from 0 to the number of steps
+        std::vector<Real> powers(Real factor) const {
+            std::vector<Real> result(this->columns());
+            for (Size k=0; k<result.size(); ++k)
+                result[k] = std::pow(factor, Real(k));
+            return result;
+        }
         Real x0_, driftPerStep_;
         Time dt_;
     };
@@ -69,13 +86,36 @@ namespace QuantLib {
                         Size steps)
         : BinomialTree_2<T>(process, end, steps) {}
         Real underlying(Size i, Size index) const {
-            BigInteger j = 2*BigInteger(index) - BigInteger(i);
             // exploiting the forward value tree centering
-            return this->x0_*std::exp(i*this->driftPerStep_ + j*this->up_);
+            return this->x0_*drifts_[i]
+                            *jumps_[2*index + this->columns()-1 - i];
         }
         Real probability(Size, Size, Size) const { return 0.5; }
       protected:
+        /*! To be called by derived classes once up_ is set.  The
+            factors exp(i*drift) and exp(j*up) are tabulated
+            separately, in n+1 and 2n+1 values for n steps, and
+            multiplied when a node is read.  The product agrees with
+            the untabulated exp(i*drift + j*up) up to rounding: the
+            relative difference is bounded by about
+            (2 + |i*drift| + |j*up|) units in the last place, the
+            second term coming from the rounding of the sum in the
+            untabulated expression.  For the nodes that matter in
+            practice, this is a few units in the last place.
+        */
+        void initializeNodes() {
+            Size n = this->columns()-1;
+            drifts_.resize(n+1);
+            for (Size i=0; i<=n; ++i)
+                drifts_[i] = std::exp(i*this->driftPerStep_);
+            jumps_.resize(2*n+1);
+            for (Size k=0; k<=2*n; ++k) {
+                BigInteger j = BigInteger(k) - BigInteger(n);
+                jumps_[k] = std::exp(j*up_);
+            }
+        }
         Real up_;
+        std::vector<Real> drifts_, jumps_;
     };
 
 
@@ -90,15 +130,26 @@ namespace QuantLib {
                         Size steps)
         : BinomialTree_2<T>(process, end, steps) {}
         Real underlying(Size i, Size index) const {
-            BigInteger j = 2*BigInteger(index) - BigInteger(i);
             // exploiting equal jump and the x0_ tree centering
-            return this->x0_*std::exp(j*this->dx_);
+            return this->x0_*nodes_[2*index + this->columns()-1 - i];
         }
         Real probability(Size, Size, Size branch) const {
             return (branch == 1 ? pu_ : pd_);
         }
       protected:
+        /*! To be called by derived classes once dx_ is set; the
+            factors exp(j*dx) of all the nodes are tabulated.
+        */
+        void initializeNodes() {
+            Size n = this->columns()-1;
+            nodes_.resize(2*n+1);
+            for (Size k=0; k<=2*n; ++k) {
+                BigInteger j = BigInteger(k) - BigInteger(n);
+                nodes_[k] = std::exp(j*dx_);
+            }
+        }
         Real dx_, pu_, pd_;
+        std::vector<Real> nodes_;
     };
 
 
@@ -158,45 +209,48 @@ namespace QuantLib {
                Size steps,
                Real strike);
         Real underlying(Size i, Size index) const {
-            return x0_ * std::pow(down_, Real(BigInteger(i)-BigInteger(index)))
-                       * std::pow(up_, Real(index));
-        };
+            return x0_ * downPowers_[i-index] * upPowers_[index];
+        }
         Real probability(Size, Size, Size branch) const {
             return (branch == 1 ? pu_ : pd_);
         }
       protected:
         Real up_, down_, pu_, pd_;
+        std::vector<Real> upPowers_, downPowers_;
     };
 
     //! Leisen & Reimer tree: multiplicative approach
     /*! \ingroup lattices */
     class LeisenReimer_2 : public BinomialTree_2<LeisenReimer_2> {
       public:
+        // the probabilities depend on x0 through log(x0/strike)
+        enum { rescalable = false };
         LeisenReimer_2(const boost::shared_ptr<StochasticProcess1D>&,
                        Time end,
                        Size steps,
                        Real strike);
         Real underlying(Size i, Size index) const {
-            return x0_ * std::pow(down_, Real(BigInteger(i)-BigInteger(index)))
-                       * std::pow(up_, Real(index));
+            return x0_ * downPowers_[i-index] * upPowers_[index];
         }
         Real probability(Size, Size, Size branch) const {
             return (branch == 1 ? pu_ : pd_);
         }
       protected:
         Real up_, down_, pu_, pd_;
+        std::vector<Real> upPowers_, downPowers_;
     };
 
 
      class Joshi4_2 : public BinomialTree_2<Joshi4_2> {
       public:
+        // the probabilities depend on x0 through log(x0/strike)
+        enum { rescalable = false };
         Joshi4_2(const boost::shared_ptr<StochasticProcess1D>&,
                  Time end,
                  Size steps,
                  Real strike);
         Real underlying(Size i, Size index) const {
-            return x0_ * std::pow(down_, Real(BigInteger(i)-BigInteger(index)))
-                       * std::pow(up_, Real(index));
+            return x0_ * downPowers_[i-index] * upPowers_[index];
         }
         Real probability(Size, Size, Size branch) const {
             return (branch == 1 ? pu_ : pd_);
@@ -204,6 +258,54 @@ namespace QuantLib {
       protected:
         Real computeUpProb(Real k, Real dj) const;
         Real up_, down_, pu_, pd_;
+        std::vector<Real> upPowers_, downPowers_;
+    };
+
+
+    //! Binomial tree with three nodes at the current time
+    /*! The tree T is built with two more steps, as if it started
+        two steps before t=0, and its nodes are rescaled so that
+        the middle node at t=0 is x0.  Step i of this tree is step
+        i+2 of T and has i+3 nodes; an option rolled back on it has
+        three values at t=0, from which delta and gamma can be
+        estimated at the current time, and the value of the middle
+        node at the second step can be used for theta.
+
+        LeisenReimer_2 and Joshi4_2 can be used, but the extra
+        steps move the strike away from the center of the nodes at
+        maturity.
+
+        \ingroup lattices
+    */
+    template <class T>
+    class ThreeNodesBinomialTree_2
+        : public BinomialTree_2<ThreeNodesBinomialTree_2<T> > {
+      public:
+        enum { rescalable = T::rescalable };
+        ThreeNodesBinomialTree_2(
+                        const boost::shared_ptr<StochasticProcess1D>& process,
+                        Time end,
+                        Size steps,
+                        Real strike)
+        : BinomialTree_2<ThreeNodesBinomialTree_2<T> >(process, end, steps),
+          tree_(process, end + 2.0*this->dt_, steps+2, strike),
+          center_(this->x0_/tree_.underlying(2, 1)) {}
+        Size size(Size i) const {
+            return i+3;
+        }
+        Real underlying(Size i, Size index) const {
+            return center_*tree_.underlying(i+2, index);
+        }
+        Real probability(Size i, Size index, Size branch) const {
+            return tree_.probability(i+2, index, branch);
+        }
+        void rescale(Real factor) {
+            BinomialTree_2<ThreeNodesBinomialTree_2<T> >::rescale(factor);
+            tree_.rescale(factor);
+        }
+      private:
+        T tree_;
+        Real center_;
     };
 
 }
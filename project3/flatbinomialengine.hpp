@@ -0,0 +1,1033 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file flatbinomialengine.hpp
+    \brief Binomial vanilla engine with in-place flat-array rollback
+*/
+
+#ifndef flat_binomial_engine_hpp
+#define flat_binomial_engine_hpp
+
+#include "binomialrollback.hpp"
+#include <ql/instruments/dividendschedule.hpp>
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/math/comparison.hpp>
+#include <ql/pricingengines/blackformula.hpp>
+#include <ql/pricingengines/greeks.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include <ql/quotes/simplequote.hpp>
+#include <ql/termstructures/yield/flatforward.hpp>
+#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include <ql/timegrid.hpp>
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace QuantLib {
+
+    namespace detail {
+
+        //! backward induction of a plain vanilla on a binomial tree
+        /*! Steps can be applied to a range of nodes stored in any
+            buffer, so that different parts of a level can be rolled
+            back independently.
+        */
+        template <class T>
+        class FlatBinomialRollback_2 {
+          public:
+            /*! exercisable tells whether the option can be exercised
+                at each step; dividends holds, for each step, the
+                value to be added to the nodes of the tree to obtain
+                the underlying value.
+            */
+            FlatBinomialRollback_2(const T& tree,
+                                   Real pu, Real pd,
+                                   DiscountFactor discount,
+                                   const PlainVanillaPayoff& payoff,
+                                   const std::vector<bool>& exercisable,
+                                   const std::vector<Real>& dividends)
+            : tree_(tree), pu_(pu), pd_(pd),
+              discount_(discount), strike_(payoff.strike()),
+              omega_(payoff.optionType() == Option::Call ? 1.0 : -1.0),
+              exercisable_(exercisable), dividends_(dividends) {}
+            //! whether the option can be exercised at step k
+            bool exerciseAt(Size k) const {
+                return exercisable_[k];
+            }
+            //! tree node j of step i, net of the dividends to be paid
+            Real netUnderlying(Size i, Size j) const {
+                return tree_.underlying(i, j);
+            }
+            //! underlying value at node j of step i
+            Real underlying(Size i, Size j) const {
+                return tree_.underlying(i, j) + dividends_[i];
+            }
+            //! payoff at node j of step i
+            Real exerciseValue(Size i, Size j) const {
+                return std::max(omega_*(underlying(i, j) - strike_), 0.0);
+            }
+            //! discounted expectation of the given values at step k+1
+            Real continuation(Real down, Real up) const {
+                return (pd_*down + pu_*up)*discount_;
+            }
+            /*! Returns the critical underlying value at step k, i.e.,
+                the one of the exercised node closest to the
+                continuation region, or Null<Real>() if none of the
+                nodes [first, last) is exercised.  values[0] holds
+                the value of node first after the rollback.  Exercise
+                is optimal on the in-the-money side of the boundary,
+                which is found by bisection.
+            */
+            Real exerciseBoundary(Size k, const Real* values,
+                                  Size first, Size last) const {
+                Size a = first, b = last;
+                while (a < b) {
+                    Size j = a + (b-a)/2;
+                    Real exercise = exerciseValue(k, j);
+                    bool exercised =
+                        exercise > 0.0 && values[j-first] <= exercise;
+                    // the nodes after the boundary are exercised for
+                    // calls and not exercised for puts
+                    if (exercised == (omega_ > 0.0))
+                        b = j;
+                    else
+                        a = j+1;
+                }
+                if (omega_ > 0.0)
+                    return a < last ? underlying(k, a) : Null<Real>();
+                else
+                    return a > first ? underlying(k, a-1) : Null<Real>();
+            }
+            //! payoff at the nodes [first, last) of step i
+            void payoff(Size i, Size first, Size last, Real* values) const {
+                Real underlying = dividends_[i] - strike_;
+                for (Size j=first; j<last; ++j)
+                    values[j-first] = std::max(
+                        omega_*(tree_.underlying(i, j) + underlying), 0.0);
+            }
+            /*! Rolls back the nodes [first, last) from step k+1 to
+                step k.  values[0] holds node first of step k+1 and
+                must hold last-first+1 values; exercise is a buffer
+                of at least last-first values.
+            */
+            void step(Size k, Size first, Size last,
+                      Real* values, Real* exercise) const {
+                if (exercisable_[k]) {
+                    payoff(k, first, last, exercise);
+                    binomialRollback(values, exercise, last-first,
+                                     pu_, pd_, discount_);
+                } else {
+                    binomialRollback(values, 0, last-first,
+                                     pu_, pd_, discount_);
+                }
+            }
+          private:
+            const T& tree_;
+            Real pu_, pd_;
+            DiscountFactor discount_;
+            Real strike_, omega_;
+            std::vector<bool> exercisable_;
+            std::vector<Real> dividends_;
+        };
+
+    }
+
+    //! Pricing engine for vanilla options on binomial trees
+    /*! The engine builds the same tree as BinomialVanillaEngine_2
+        and returns the same results, but it doesn't go through
+        BlackScholesLattice and DiscretizedVanillaOption: the option
+        values are stored in a single contiguous array and rolled
+        back in place by a vectorized kernel (see
+        binomialrollback.hpp), which also applies the early-exercise
+        condition.  As in BlackScholesLattice, the branch
+        probabilities are taken from the first step of the tree and
+        the discount factor is constant.
+
+        For very large trees, the rollback can be spread over
+        several threads.  Levels are split in tiles of a couple of
+        thousand nodes; each tile is rolled back over a block of
+        time steps from a private copy of its nodes plus the ones
+        it depends on, so that threads only synchronize once per
+        block.  Tiles overlap slightly, which costs some redundant
+        work; the results, including the exercise boundary (which
+        each tile looks for among its own nodes), are the same as
+        the single-threaded ones.
+
+        Optionally, the option can be priced on two trees and the
+        results combined.  Richardson extrapolation uses N and 2N
+        steps and returns 2P(2N) - P(N), which cancels the leading
+        1/N error term for trees with smooth convergence; averaging
+        uses N and N+1 steps and returns their mean, which cancels
+        most of the odd-even oscillation of trees such as
+        CoxRossRubinstein_2.  Delta and gamma are combined in the
+        same way, and theta is derived from the combined results.
+
+        Finally, Black-Scholes smoothing can be used: the values at
+        the last step before maturity are set to the analytic
+        Black-Scholes prices of the European option over the
+        remaining time step (subject to early exercise, if allowed)
+        which removes the kink of the payoff from the tree and
+        makes convergence smooth.  Together with Richardson
+        extrapolation, this gives the BBSR method of Broadie and
+        Detemple.
+
+        Bermudan exercise and cash dividends don't require the
+        generic lattice machinery either.  The steps at which the
+        option can be exercised are found before the rollback, with
+        each Bermudan date moved to the closest step.  Dividends
+        are modeled by building the tree on the underlying value
+        net of the present value of the dividends paid until
+        maturity (the escrowed dividend model) and adding back, at
+        each step, the present value of the dividends still to be
+        paid, including those paid on the date of the step, so that
+        the option can be exercised before the payment.  Dividends
+        paid at maturity are not received by the option and are
+        ignored, with or without smoothing.  The added amounts are
+        also computed beforehand, so that the early-exercise
+        condition costs a single addition per node.
+
+        During the rollback, the early-exercise boundary is found at
+        each exercise step and returned in the additional results
+        "exerciseTimes" and "exerciseBoundary" (the critical
+        underlying values); with extrapolation, they refer to the
+        finer tree.  Optionally, the rollback can be truncated.
+        Nodes farther than a given number of standard deviations
+        (over the life of the option) from the strike are not
+        rolled back: their values are set to zero if they're out of
+        the money, or to the discounted forward intrinsic value
+        (subject to early exercise) if they're in the money.
+        Moreover, the boundary is found before rolling back each
+        exercise step, by bisection on the continuation values; the
+        nodes beyond it are known to be exercised and their values
+        are not stored.  Only the values at the edges of the
+        rolled-back range are computed when needed by the next
+        step.  Truncation is only available for single-threaded
+        rollbacks.
+
+        In adjoint mode, the rollback only stores the exercise
+        decision at each node, as a single bit, and carries the
+        derivatives of the option values with respect to the branch
+        probabilities and the discount factor along with the values.
+        The adjoint of the rollback is then propagated from the
+        price in a single reverse sweep through the stored
+        decisions, accumulating the sensitivities to the underlying
+        values at the nodes where the option is exercised.  Only
+        the rollback is differentiated: the sensitivities of the
+        tree parameters (branch probabilities and node values) to
+        the spot, the volatility and the rates are finite
+        differences, obtained by building eight trees with bumped
+        inputs and with no further rollbacks.  The cost of the
+        bumped trees depends on T: the trees in binomialtree.hpp
+        tabulate O(n) factors when built, while the QuantLib trees
+        compute each node when read, so that the reverse sweep
+        evaluates eight nodes for each exercised node.  The
+        results are the delta,
+        vega, rho and dividend rho of the tree price; the gamma is
+        estimated as in the other modes.  The adjoint mode runs on a
+        single thread and can't be used with Black-Scholes
+        smoothing, dividends or truncation.
+
+        The tree class T only needs the constructor and the
+        underlying(), probability() and size() methods used by
+        BinomialVanillaEngine_2, so that the QuantLib binomial
+        trees and the ones in binomialtree.hpp (except
+        ThreeNodesBinomialTree_2) can be used.
+
+        \ingroup vanillaengines
+    */
+    template <class T>
+    class FlatBinomialVanillaEngine_2 : public VanillaOption::engine {
+      public:
+        enum Extrapolation { NoExtrapolation, Richardson, TwoTreeAverage };
+        FlatBinomialVanillaEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Size threads = 1,
+             Extrapolation extrapolation = NoExtrapolation,
+             bool blackScholesSmoothing = false,
+             bool adjointGreeks = false,
+             const DividendSchedule& dividends = DividendSchedule(),
+             Real truncation = 0.0)
+        : process_(process), timeSteps_(timeSteps), threads_(threads),
+          extrapolation_(extrapolation),
+          blackScholesSmoothing_(blackScholesSmoothing),
+          adjointGreeks_(adjointGreeks),
+          dividends_(dividends), truncation_(truncation) {
+            QL_REQUIRE(timeSteps >= 2,
+                       "at least 2 time steps required, "
+                       << timeSteps << " provided");
+            // the Greeks are read at the second step
+            QL_REQUIRE(!blackScholesSmoothing || timeSteps >= 3,
+                       "at least 3 time steps required with "
+                       "Black-Scholes smoothing, "
+                       << timeSteps << " provided");
+            QL_REQUIRE(threads > 0, "at least one thread required");
+            QL_REQUIRE(truncation >= 0.0,
+                       "negative truncation (" << truncation << ") given");
+            QL_REQUIRE(truncation == 0.0 || threads == 1,
+                       "truncation requires a single thread");
+            QL_REQUIRE(!adjointGreeks || (threads == 1 &&
+                                          !blackScholesSmoothing &&
+                                          dividends.empty() &&
+                                          truncation == 0.0),
+                       "adjoint Greeks require a single thread and "
+                       "no Black-Scholes smoothing, dividends or "
+                       "truncation");
+            registerWith(process_);
+        }
+        void calculate() const;
+      private:
+        enum { tileSize = 2048, blockSteps = 128 };
+        //! results on a single tree
+        struct TreeResults {
+            TreeResults()
+            : value(0.0), delta(0.0), gamma(0.0),
+              vega(0.0), rho(0.0), dividendRho(0.0) {}
+            Real value, delta, gamma, vega, rho, dividendRho;
+            //! critical underlying values, forward in time
+            std::vector<Time> exerciseTimes;
+            std::vector<Real> exerciseBoundary;
+        };
+        boost::shared_ptr<StochasticProcess1D> flatProcess(
+                                          const Handle<Quote>& underlying,
+                                          Rate riskFreeRate,
+                                          Rate dividendYield,
+                                          Volatility volatility) const;
+        TreeResults price(const boost::shared_ptr<StochasticProcess1D>& process,
+                          Rate riskFreeRate,
+                          Rate dividendYield,
+                          Volatility volatility,
+                          Time maturity,
+                          const PlainVanillaPayoff& payoff,
+                          Size timeSteps) const;
+        Size parallelRollback(const detail::FlatBinomialRollback_2<T>& rollback,
+                              const TimeGrid& grid,
+                              std::vector<Real>& values,
+                              std::vector<Time>& exerciseTimes,
+                              std::vector<Real>& exerciseBoundary) const;
+        Size truncatedRollback(const detail::FlatBinomialRollback_2<T>& rollback,
+                               const TimeGrid& grid,
+                               Rate riskFreeRate,
+                               Rate dividendYield,
+                               Volatility volatility,
+                               std::vector<Real>& values,
+                               std::vector<Time>& exerciseTimes,
+                               std::vector<Real>& exerciseBoundary) const;
+        void adjointRollback(const T& tree,
+                             const detail::FlatBinomialRollback_2<T>& rollback,
+                             const TimeGrid& grid,
+                             std::vector<Real>& values,
+                             Rate riskFreeRate,
+                             Rate dividendYield,
+                             Volatility volatility,
+                             Time maturity,
+                             const PlainVanillaPayoff& payoff,
+                             Size timeSteps,
+                             TreeResults& results) const;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size timeSteps_, threads_;
+        Extrapolation extrapolation_;
+        bool blackScholesSmoothing_, adjointGreeks_;
+        DividendSchedule dividends_;
+        Real truncation_;
+    };
+
+
+    // template definitions
+
+    template <class T>
+    void FlatBinomialVanillaEngine_2<T>::calculate() const {
+
+        DayCounter rfdc  = process_->riskFreeRate()->dayCounter();
+        DayCounter divdc = process_->dividendYield()->dayCounter();
+
+        Real s0 = process_->stateVariable()->value();
+        QL_REQUIRE(s0 > 0.0, "negative or null underlying given");
+        Volatility v = process_->blackVolatility()->blackVol(
+            arguments_.exercise->lastDate(), s0);
+        Date maturityDate = arguments_.exercise->lastDate();
+        Rate r = process_->riskFreeRate()->zeroRate(maturityDate,
+            rfdc, Continuous, NoFrequency);
+        Rate q = process_->dividendYield()->zeroRate(maturityDate,
+            divdc, Continuous, NoFrequency);
+        Date referenceDate = process_->riskFreeRate()->referenceDate();
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        Time maturity = rfdc.yearFraction(referenceDate, maturityDate);
+
+        // the tree is built on the underlying value net of the
+        // dividends paid until maturity
+        Handle<Quote> underlying = process_->stateVariable();
+        if (!dividends_.empty()) {
+            Real escrowed = 0.0;
+            for (Size d=0; d<dividends_.size(); ++d) {
+                Time t = process_->time(dividends_[d]->date());
+                if (t > 0.0 && t < maturity && !close_enough(t, maturity))
+                    escrowed += dividends_[d]->amount()*std::exp(-r*t);
+            }
+            QL_REQUIRE(s0 > escrowed,
+                       "dividends (" << escrowed << ") exceed the "
+                       "underlying value (" << s0 << ")");
+            underlying = Handle<Quote>(
+                boost::shared_ptr<Quote>(new SimpleQuote(s0 - escrowed)));
+        }
+
+        // binomial trees with constant coefficient
+        boost::shared_ptr<StochasticProcess1D> bs =
+            flatProcess(underlying, r, q, v);
+
+        TreeResults results;
+        switch (extrapolation_) {
+          case NoExtrapolation:
+            results = price(bs, r, q, v, maturity, *payoff, timeSteps_);
+            break;
+          case Richardson:
+          case TwoTreeAverage: {
+              Size coarseSteps = timeSteps_;
+              Size fineSteps =
+                  extrapolation_ == Richardson ? 2*timeSteps_ : timeSteps_+1;
+              TreeResults coarse =
+                  price(bs, r, q, v, maturity, *payoff, coarseSteps);
+              TreeResults fine =
+                  price(bs, r, q, v, maturity, *payoff, fineSteps);
+              // weight of the finer tree
+              Real w = extrapolation_ == Richardson ? 2.0 : 0.5;
+              results.value = w*fine.value + (1.0-w)*coarse.value;
+              results.delta = w*fine.delta + (1.0-w)*coarse.delta;
+              results.gamma = w*fine.gamma + (1.0-w)*coarse.gamma;
+              results.vega = w*fine.vega + (1.0-w)*coarse.vega;
+              results.rho = w*fine.rho + (1.0-w)*coarse.rho;
+              results.dividendRho =
+                  w*fine.dividendRho + (1.0-w)*coarse.dividendRho;
+              // the boundary refers to the finer tree
+              results.exerciseTimes.swap(fine.exerciseTimes);
+              results.exerciseBoundary.swap(fine.exerciseBoundary);
+              results_.additionalResults["coarseValue"] = coarse.value;
+              results_.additionalResults["fineValue"] = fine.value;
+            }
+            break;
+          default:
+            QL_FAIL("unknown extrapolation");
+        }
+
+        // Store results
+        results_.value = results.value;
+        results_.delta = results.delta;
+        results_.gamma = results.gamma;
+        results_.theta = blackScholesTheta(process_,
+                                           results_.value,
+                                           results_.delta,
+                                           results_.gamma);
+        if (adjointGreeks_) {
+            results_.vega = results.vega;
+            results_.rho = results.rho;
+            results_.dividendRho = results.dividendRho;
+        }
+        if (!results.exerciseTimes.empty()) {
+            results_.additionalResults["exerciseTimes"] =
+                results.exerciseTimes;
+            results_.additionalResults["exerciseBoundary"] =
+                results.exerciseBoundary;
+        }
+    }
+
+
+    template <class T>
+    boost::shared_ptr<StochasticProcess1D>
+    FlatBinomialVanillaEngine_2<T>::flatProcess(
+                                          const Handle<Quote>& underlying,
+                                          Rate riskFreeRate,
+                                          Rate dividendYield,
+                                          Volatility volatility) const {
+
+        DayCounter rfdc  = process_->riskFreeRate()->dayCounter();
+        DayCounter divdc = process_->dividendYield()->dayCounter();
+        DayCounter voldc = process_->blackVolatility()->dayCounter();
+        Calendar volcal = process_->blackVolatility()->calendar();
+        Date referenceDate = process_->riskFreeRate()->referenceDate();
+
+        Handle<YieldTermStructure> flatRiskFree(
+            boost::shared_ptr<YieldTermStructure>(
+                new FlatForward(referenceDate, riskFreeRate, rfdc)));
+        Handle<YieldTermStructure> flatDividends(
+            boost::shared_ptr<YieldTermStructure>(
+                new FlatForward(referenceDate, dividendYield, divdc)));
+        Handle<BlackVolTermStructure> flatVol(
+            boost::shared_ptr<BlackVolTermStructure>(
+                new BlackConstantVol(referenceDate, volcal, volatility, voldc)));
+
+        return boost::shared_ptr<StochasticProcess1D>(
+                         new GeneralizedBlackScholesProcess(
+                                      underlying,
+                                      flatDividends, flatRiskFree, flatVol));
+    }
+
+
+    template <class T>
+    typename FlatBinomialVanillaEngine_2<T>::TreeResults
+    FlatBinomialVanillaEngine_2<T>::price(
+                        const boost::shared_ptr<StochasticProcess1D>& process,
+                        Rate riskFreeRate,
+                        Rate dividendYield,
+                        Volatility volatility,
+                        Time maturity,
+                        const PlainVanillaPayoff& payoff,
+                        Size timeSteps) const {
+
+        TimeGrid grid(maturity, timeSteps);
+
+        boost::shared_ptr<T> tree(new T(process, maturity, timeSteps,
+                                        payoff.strike()));
+        QL_REQUIRE(tree->size(0) == 1,
+                   "trees with more than one node at t=0 not supported");
+
+        // same conventions as BlackScholesLattice
+        Real pu = tree->probability(0, 0, 1);
+        Real pd = tree->probability(0, 0, 0);
+        DiscountFactor discount = std::exp(-riskFreeRate*(maturity/timeSteps));
+
+        Size n = timeSteps;
+
+        // exercise steps; the American window is the same as in
+        // DiscretizedVanillaOption, while Bermudan dates are moved
+        // to the closest step
+        std::vector<bool> exercisable(n+1, false);
+        switch (arguments_.exercise->type()) {
+          case Exercise::European:
+            break;
+          case Exercise::American: {
+              Time exerciseStart =
+                  process_->time(arguments_.exercise->date(0));
+              Time exerciseEnd =
+                  process_->time(arguments_.exercise->lastDate());
+              for (Size k=0; k<=n; ++k)
+                  exercisable[k] =
+                      grid[k] >= exerciseStart && grid[k] <= exerciseEnd;
+            }
+            break;
+          case Exercise::Bermudan:
+            for (Size d=0; d<arguments_.exercise->dates().size(); ++d) {
+                Time t = process_->time(arguments_.exercise->date(d));
+                if (t >= 0.0)
+                    exercisable[grid.closestIndex(t)] = true;
+            }
+            break;
+          default:
+            QL_FAIL("unknown exercise type");
+        }
+
+        // present value at each step of the dividends paid from it
+        // on; at a step falling on a dividend date, the underlying
+        // is taken before the payment, so that exercise on that date
+        // still collects the dividend.  A step within rounding of the
+        // payment time is taken as falling on it; dividends paid at
+        // maturity are not received by the option and are ignored,
+        // as in the escrowed amount above.
+        std::vector<Real> dividends(n+1, 0.0);
+        for (Size d=0; d<dividends_.size(); ++d) {
+            Time t = process_->time(dividends_[d]->date());
+            if (t <= 0.0 || t >= maturity || close_enough(t, maturity))
+                continue;
+            Real amount = dividends_[d]->amount();
+            // last step on or before the payment
+            Size last = grid.closestIndex(t);
+            if (grid[last] > t && !close_enough(grid[last], t))
+                --last;
+            for (Size k=0; k<=last; ++k)
+                dividends[k] += amount*std::exp(-riskFreeRate*(t-grid[k]));
+        }
+
+        detail::FlatBinomialRollback_2<T> rollback(*tree, pu, pd, discount,
+                                                   payoff, exercisable,
+                                                   dividends);
+
+        std::vector<Real> values;
+        if (blackScholesSmoothing_) {
+            // European values over the last step, then exercise;
+            // the nodes are net of dividends, as is the underlying
+            // value at maturity
+            Size k = n-1;
+            Time dt = maturity/timeSteps;
+            Real growth = std::exp((riskFreeRate - dividendYield)*dt);
+            Real stdDev = volatility*std::sqrt(dt);
+            values.resize(n);
+            for (Size j=0; j<=k; ++j)
+                values[j] = blackFormula(payoff.optionType(),
+                                         payoff.strike(),
+                                         tree->underlying(k, j)*growth,
+                                         stdDev, discount);
+            if (rollback.exerciseAt(k)) {
+                std::vector<Real> exercise(n);
+                rollback.payoff(k, 0, k+1, &exercise[0]);
+                for (Size j=0; j<=k; ++j)
+                    values[j] = std::max(values[j], exercise[j]);
+            }
+        } else {
+            values.resize(n+1);
+            rollback.payoff(n, 0, n+1, &values[0]);
+        }
+
+        TreeResults results;
+        if (adjointGreeks_) {
+            adjointRollback(*tree, rollback, grid, values,
+                            riskFreeRate, dividendYield, volatility,
+                            maturity, payoff, timeSteps, results);
+            return results;
+        }
+
+        // the boundary is collected backwards in time
+        std::vector<Time>& exerciseTimes = results.exerciseTimes;
+        std::vector<Real>& exerciseBoundary = results.exerciseBoundary;
+
+        Size i = values.size()-1;
+        if (threads_ > 1)
+            i = parallelRollback(rollback, grid, values,
+                                 exerciseTimes, exerciseBoundary);
+        else if (truncation_ > 0.0)
+            i = truncatedRollback(rollback, grid, riskFreeRate,
+                                  dividendYield, volatility, values,
+                                  exerciseTimes, exerciseBoundary);
+
+        std::vector<Real> exercise(i);
+        Real p2u = 0.0, p2m = 0.0, p2d = 0.0, p1u = 0.0, p1d = 0.0;
+        // the values at steps 2 and 1 are read when the rollback
+        // reaches them, unless it starts there (with two steps, or
+        // three with Black-Scholes smoothing)
+        if (i == 2) {
+            p2d = values[0];
+            p2m = values[1];
+            p2u = values[2];
+        } else if (i == 1) {
+            p1d = values[0];
+            p1u = values[1];
+        }
+        for (; i>0; --i) {
+            // roll back from step i to step i-1
+            Size k = i-1;
+            rollback.step(k, 0, k+1, &values[0], &exercise[0]);
+            if (rollback.exerciseAt(k)) {
+                Real boundary =
+                    rollback.exerciseBoundary(k, &values[0], 0, k+1);
+                if (boundary != Null<Real>()) {
+                    exerciseTimes.push_back(grid[k]);
+                    exerciseBoundary.push_back(boundary);
+                }
+            }
+            if (k == 2) {
+                p2d = values[0];
+                p2m = values[1];
+                p2u = values[2];
+            } else if (k == 1) {
+                p1d = values[0];
+                p1u = values[1];
+            }
+        }
+
+        // Partial derivatives calculated from various points in the
+        // binomial tree
+        // (see J.C.Hull, "Options, Futures and other derivatives", 6th edition, pp 397/398)
+        Real s2u = tree->underlying(2, 2); // up price
+        Real s2m = tree->underlying(2, 1); // middle price
+        Real s2d = tree->underlying(2, 0); // down (low) price
+
+        // calculate gamma by taking the first derivate of the two deltas
+        Real delta2u = (p2u - p2m)/(s2u-s2m);
+        Real delta2d = (p2m-p2d)/(s2m-s2d);
+        results.gamma = (delta2u - delta2d) / ((s2u-s2d)/2);
+
+        Real s1u = tree->underlying(1, 1); // up (high) price
+        Real s1d = tree->underlying(1, 0); // down (low) price
+
+        results.delta = (p1u - p1d) / (s1u - s1d);
+        results.value = values[0];
+
+        std::reverse(exerciseTimes.begin(), exerciseTimes.end());
+        std::reverse(exerciseBoundary.begin(), exerciseBoundary.end());
+        return results;
+    }
+
+
+    template <class T>
+    Size FlatBinomialVanillaEngine_2<T>::parallelRollback(
+                            const detail::FlatBinomialRollback_2<T>& rollback,
+                            const TimeGrid& grid,
+                            std::vector<Real>& values,
+                            std::vector<Time>& exerciseTimes,
+                            std::vector<Real>& exerciseBoundary) const {
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+        bool call = payoff->optionType() == Option::Call;
+
+        // rolls back blocks of steps while the levels span a few
+        // tiles; returns the step reached, from which the rollback
+        // continues serially
+        Size level = values.size()-1;
+        Size minLevel = 4*tileSize;
+        std::vector<Real> next(values.size());
+        while (level > minLevel) {
+            Size steps = std::min<Size>(blockSteps, level-minLevel);
+            Size target = level-steps;
+            Size tiles = (target+1 + tileSize-1)/tileSize;
+            Size m = std::min(threads_, tiles);
+
+            // each tile looks for the boundary among its own nodes,
+            // i.e., excluding the ones it shares with the next tile
+            std::vector<Real> boundaries(tiles*steps, Null<Real>());
+
+            std::vector<std::exception_ptr> errors(m);
+            std::vector<std::thread> threads;
+            threads.reserve(m);
+            for (Size t=0; t<m; ++t) {
+                // contiguous tiles for each thread
+                Size firstTile = t*tiles/m, lastTile = (t+1)*tiles/m;
+                threads.push_back(std::thread(
+                    [&, t, firstTile, lastTile]() {
+                        try {
+                            std::vector<Real> buffer(tileSize+steps+1),
+                                              exercise(tileSize+steps);
+                            for (Size k=firstTile; k<lastTile; ++k) {
+                                Size a = k*tileSize;
+                                Size b = std::min<Size>(a+tileSize, target+1);
+                                // nodes of the starting level needed
+                                // for [a, b) at the target level
+                                std::copy(values.begin()+a,
+                                          values.begin()+(b+steps),
+                                          buffer.begin());
+                                for (Size s=1; s<=steps; ++s) {
+                                    Size i = level-s;
+                                    rollback.step(i, a, b+steps-s,
+                                                  &buffer[0], &exercise[0]);
+                                    if (rollback.exerciseAt(i)) {
+                                        Size last = k+1 == tiles ?
+                                            b+steps-s : b;
+                                        boundaries[k*steps+s-1] =
+                                            rollback.exerciseBoundary(
+                                                i, &buffer[0], a, last);
+                                    }
+                                }
+                                std::copy(buffer.begin(),
+                                          buffer.begin()+(b-a),
+                                          next.begin()+a);
+                            }
+                        } catch (...) {
+                            errors[t] = std::current_exception();
+                        }
+                    }));
+            }
+            for (Size t=0; t<m; ++t)
+                threads[t].join();
+            for (Size t=0; t<m; ++t) {
+                if (errors[t])
+                    std::rethrow_exception(errors[t]);
+            }
+            std::copy(next.begin(), next.begin()+(target+1), values.begin());
+
+            // the exercise region is on the right of the boundary for
+            // calls and on the left for puts, so the critical value
+            // is the lowest or highest one found among the tiles
+            for (Size s=1; s<=steps; ++s) {
+                Real boundary = Null<Real>();
+                for (Size k=0; k<tiles; ++k) {
+                    Real b = boundaries[k*steps+s-1];
+                    if (b == Null<Real>())
+                        continue;
+                    if (boundary == Null<Real>() ||
+                        (call ? b < boundary : b > boundary))
+                        boundary = b;
+                }
+                if (boundary != Null<Real>()) {
+                    exerciseTimes.push_back(grid[level-s]);
+                    exerciseBoundary.push_back(boundary);
+                }
+            }
+            level = target;
+        }
+        return level;
+    }
+
+
+    template <class T>
+    Size FlatBinomialVanillaEngine_2<T>::truncatedRollback(
+                            const detail::FlatBinomialRollback_2<T>& rollback,
+                            const TimeGrid& grid,
+                            Rate riskFreeRate,
+                            Rate dividendYield,
+                            Volatility volatility,
+                            std::vector<Real>& values,
+                            std::vector<Time>& exerciseTimes,
+                            std::vector<Real>& exerciseBoundary) const {
+
+        // rolls back down to the third step, whose nodes are all
+        // stored on return, so that the Greeks can be read as usual
+        Size level = values.size()-1;
+        if (level <= 3)
+            return level;
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+        Real omega = payoff->optionType() == Option::Call ? 1.0 : -1.0;
+        Real strike = payoff->strike();
+        Time maturity = grid.back();
+
+        // nodes with underlying values outside [lower, upper] are
+        // not rolled back
+        Real width = truncation_*volatility*std::sqrt(maturity);
+        Real lower = strike*std::exp(-width), upper = strike*std::exp(width);
+
+        // values holds the nodes [lo, hi) of the current level; the
+        // nodes of the band are [bandLo, bandHi)
+        Size lo = 0, hi = level+1, bandLo = 0, bandHi = level+1;
+
+        // value of a node that is not stored: zero on the
+        // out-of-the-money side, forward intrinsic value (or
+        // exercise value, if larger and allowed) on the other side
+        auto implicitValue = [&](Size i, Size j) -> Real {
+            bool inTheMoney = (j >= hi) == (omega > 0.0);
+            if (!inTheMoney)
+                return 0.0;
+            Time tau = maturity - grid[i];
+            Real value = std::max(
+                omega*(rollback.netUnderlying(i, j)*std::exp(-dividendYield*tau)
+                       - strike*std::exp(-riskFreeRate*tau)), 0.0);
+            if (rollback.exerciseAt(i))
+                value = std::max(value, rollback.exerciseValue(i, j));
+            return value;
+        };
+
+        std::vector<Real> exercise(level);
+        for (; level>3; --level) {
+            // roll back from step level to step k
+            Size k = level-1;
+            auto nextValue = [&](Size j) -> Real {
+                return j >= lo && j < hi ? values[j] : implicitValue(level, j);
+            };
+
+            // band at step k, moved from the one at the previous step
+            Size first = std::min(bandLo, k), last = std::min(bandHi, k+1);
+            while (first > 0 && rollback.underlying(k, first-1) >= lower)
+                --first;
+            while (first <= k && rollback.underlying(k, first) < lower)
+                ++first;
+            last = std::max(last, first);
+            while (last <= k && rollback.underlying(k, last) <= upper)
+                ++last;
+            while (last > first && rollback.underlying(k, last-1) > upper)
+                --last;
+
+            // nodes to be rolled back
+            Size from = first, to = last;
+            if (rollback.exerciseAt(k)) {
+                Size a = first, b = last;
+                while (a < b) {
+                    Size j = a + (b-a)/2;
+                    bool exercised = rollback.exerciseValue(k, j) >
+                        rollback.continuation(nextValue(j), nextValue(j+1));
+                    // the nodes after the boundary are exercised for
+                    // calls and not exercised for puts
+                    if (exercised == (omega > 0.0))
+                        b = j;
+                    else
+                        a = j+1;
+                }
+                Real boundary = Null<Real>();
+                if (omega > 0.0) {
+                    to = a;
+                    if (a < last)
+                        boundary = rollback.underlying(k, a);
+                } else {
+                    from = a;
+                    if (a > first)
+                        boundary = rollback.underlying(k, a-1);
+                }
+                if (boundary != Null<Real>()) {
+                    exerciseTimes.push_back(grid[k]);
+                    exerciseBoundary.push_back(boundary);
+                }
+            }
+
+            // store the values needed at the edges
+            for (Size j=from; j<std::min(lo, to+1); ++j)
+                values[j] = implicitValue(level, j);
+            for (Size j=std::max(hi, from); j<=to; ++j)
+                values[j] = implicitValue(level, j);
+
+            if (to > from)
+                rollback.step(k, from, to, &values[from], &exercise[0]);
+
+            lo = from;
+            hi = to;
+            bandLo = first;
+            bandHi = last;
+        }
+
+        for (Size j=0; j<lo; ++j)
+            values[j] = implicitValue(level, j);
+        for (Size j=hi; j<=level; ++j)
+            values[j] = implicitValue(level, j);
+        return level;
+    }
+
+    template <class T>
+    void FlatBinomialVanillaEngine_2<T>::adjointRollback(
+                            const T& tree,
+                            const detail::FlatBinomialRollback_2<T>& rollback,
+                            const TimeGrid& grid,
+                            std::vector<Real>& values,
+                            Rate riskFreeRate,
+                            Rate dividendYield,
+                            Volatility volatility,
+                            Time maturity,
+                            const PlainVanillaPayoff& payoff,
+                            Size timeSteps,
+                            TreeResults& results) const {
+
+        Real pu = tree.probability(0, 0, 1);
+        Real pd = tree.probability(0, 0, 0);
+        Time dt = maturity/timeSteps;
+        DiscountFactor discount = std::exp(-riskFreeRate*dt);
+
+        // forward sweep; the values are rolled back in place as in
+        // price(), together with their derivatives with respect to
+        // pu, pd and the discount factor.  The exercise decision at
+        // node j of step k is stored as a single bit at position
+        // k(k+1)/2+j, which is all the reverse sweep needs.
+        Size n = timeSteps;
+        std::vector<bool> exercised(n*(n+1)/2, false);
+        std::vector<Real> puTangents(n+1, 0.0), pdTangents(n+1, 0.0),
+                          discountTangents(n+1, 0.0);
+        std::vector<Real> exercise(n);
+        // the values at the second step, for the gamma
+        Real p2[3];
+        if (n == 2)
+            std::copy(values.begin(), values.begin()+3, p2);
+        for (Size i=n; i>0; --i) {
+            Size k = i-1;
+            bool exercisable = rollback.exerciseAt(k);
+            // the tangents are updated before the values, which they
+            // depend on; node j only reads nodes j and j+1, so both
+            // can be updated in place
+            for (Size j=0; j<=k; ++j) {
+                Real down = values[j], up = values[j+1];
+                if (exercisable && rollback.exerciseValue(k, j) >
+                                   rollback.continuation(down, up)) {
+                    exercised[k*(k+1)/2+j] = true;
+                    puTangents[j] = pdTangents[j] = discountTangents[j] = 0.0;
+                } else {
+                    puTangents[j] =
+                        rollback.continuation(puTangents[j], puTangents[j+1])
+                        + discount*up;
+                    pdTangents[j] =
+                        rollback.continuation(pdTangents[j], pdTangents[j+1])
+                        + discount*down;
+                    discountTangents[j] =
+                        rollback.continuation(discountTangents[j],
+                                              discountTangents[j+1])
+                        + (pd*down + pu*up);
+                }
+            }
+            rollback.step(k, 0, k+1, &values[0], &exercise[0]);
+            if (k == 2)
+                std::copy(values.begin(), values.begin()+3, p2);
+            if (exercisable) {
+                Real boundary =
+                    rollback.exerciseBoundary(k, &values[0], 0, k+1);
+                if (boundary != Null<Real>()) {
+                    results.exerciseTimes.push_back(grid[k]);
+                    results.exerciseBoundary.push_back(boundary);
+                }
+            }
+        }
+        std::reverse(results.exerciseTimes.begin(),
+                     results.exerciseTimes.end());
+        std::reverse(results.exerciseBoundary.begin(),
+                     results.exerciseBoundary.end());
+
+        // sensitivities of the tree parameters to the inputs (spot,
+        // volatility, risk-free rate, dividend yield).  These are not
+        // obtained by differentiation: for a generic tree class, the
+        // derivatives of the branch probabilities and of the node
+        // values are central finite differences between trees built
+        // with bumped inputs.  Only the rollback is differentiated.
+        Real s0 = process_->stateVariable()->value();
+        Real h[4] = { 1.0e-4*s0, 1.0e-4, 1.0e-4, 1.0e-4 };
+        std::vector<boost::shared_ptr<T> > upTrees(4), downTrees(4);
+        for (Size p=0; p<4; ++p) {
+            for (Integer sign=-1; sign<=1; sign+=2) {
+                Real bump[4] = { 0.0, 0.0, 0.0, 0.0 };
+                bump[p] = sign*h[p];
+                Handle<Quote> x0(
+                    boost::shared_ptr<Quote>(new SimpleQuote(s0+bump[0])));
+                boost::shared_ptr<T> bumpedTree(
+                    new T(flatProcess(x0, riskFreeRate+bump[2],
+                                      dividendYield+bump[3],
+                                      volatility+bump[1]),
+                          maturity, timeSteps, payoff.strike()));
+                (sign > 0 ? upTrees : downTrees)[p] = bumpedTree;
+            }
+        }
+
+        // reverse sweep: the adjoints of the values at each step are
+        // propagated to the next one through the continuation nodes,
+        // and to the underlying values at the exercised nodes, which
+        // are read from the stored exercise decisions
+        Real omega = payoff.optionType() == Option::Call ? 1.0 : -1.0;
+        std::vector<Real> adjoints(n+1, 0.0), nextAdjoints(n+1);
+        adjoints[0] = 1.0;
+        Real sensitivities[4] = { 0.0, 0.0, 0.0, 0.0 };
+        for (Size k=0; k<=n; ++k) {
+            if (k < n)
+                std::fill(nextAdjoints.begin(), nextAdjoints.begin()+(k+2),
+                          0.0);
+            for (Size j=0; j<=k; ++j) {
+                Real a = adjoints[j];
+                if (a == 0.0)
+                    continue;
+                if (k < n ? bool(exercised[k*(k+1)/2+j])
+                          : rollback.exerciseValue(k, j) > 0.0) {
+                    for (Size p=0; p<4; ++p)
+                        sensitivities[p] +=
+                            a*omega*(upTrees[p]->underlying(k, j) -
+                                     downTrees[p]->underlying(k, j))/(2.0*h[p]);
+                } else if (k < n) {
+                    nextAdjoints[j] += a*discount*pd;
+                    nextAdjoints[j+1] += a*discount*pu;
+                }
+            }
+            adjoints.swap(nextAdjoints);
+        }
+
+        Real greeks[4];
+        for (Size p=0; p<4; ++p) {
+            Real dpu = (upTrees[p]->probability(0, 0, 1) -
+                        downTrees[p]->probability(0, 0, 1))/(2.0*h[p]);
+            Real dpd = (upTrees[p]->probability(0, 0, 0) -
+                        downTrees[p]->probability(0, 0, 0))/(2.0*h[p]);
+            greeks[p] = sensitivities[p]
+                      + puTangents[0]*dpu + pdTangents[0]*dpd;
+        }
+        // only the discount factor depends on the rate explicitly
+        greeks[2] += discountTangents[0]*(-dt*discount);
+
+        // gamma as in price()
+        Real s2u = tree.underlying(2, 2);
+        Real s2m = tree.underlying(2, 1);
+        Real s2d = tree.underlying(2, 0);
+        Real delta2u = (p2[2] - p2[1])/(s2u-s2m);
+        Real delta2d = (p2[1]-p2[0])/(s2m-s2d);
+
+        results.value = values[0];
+        results.delta = greeks[0];
+        results.gamma = (delta2u - delta2d) / ((s2u-s2d)/2);
+        results.vega = greeks[1];
+        results.rho = greeks[2];
+        results.dividendRho = greeks[3];
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,113 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include "impliedvolatilities.hpp"
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/quotes/simplequote.hpp>
+#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include <ql/time/calendars/nullcalendar.hpp>
+#include <algorithm>
+#include <numeric>
+
+namespace QuantLib {
+
+    VanillaImpliedVolatilities_2::VanillaImpliedVolatilities_2(
+             const Handle<Quote>& underlying,
+             const Handle<YieldTermStructure>& dividendYield,
+             const Handle<YieldTermStructure>& riskFreeRate,
+             const std::vector<boost::shared_ptr<PlainVanillaPayoff> >& payoffs,
+             const boost::shared_ptr<Exercise>& exercise,
+             const std::vector<Real>& prices,
+             const engine_factory& engineFactory,
+             Real accuracy,
+             Size maxIterations,
+             Volatility guess,
+             Volatility minVol,
+             Volatility maxVol)
+    : underlying_(underlying), dividendYield_(dividendYield),
+      riskFreeRate_(riskFreeRate), payoffs_(payoffs), exercise_(exercise),
+      prices_(prices), engineFactory_(engineFactory), accuracy_(accuracy),
+      maxIterations_(maxIterations), guess_(guess), minVol_(minVol),
+      maxVol_(maxVol) {
+        QL_REQUIRE(!payoffs.empty(), "no payoffs given");
+        QL_REQUIRE(prices.size() == payoffs.size(),
+                   "mismatch between payoffs (" << payoffs.size()
+                   << ") and prices (" << prices.size() << ")");
+        QL_REQUIRE(accuracy > 0.0, "positive accuracy required");
+        QL_REQUIRE(maxIterations > 0, "at least one iteration required");
+        QL_REQUIRE(minVol > 0.0 && minVol < maxVol,
+                   "invalid volatility range [" << minVol << ", "
+                   << maxVol << "]");
+        QL_REQUIRE(guess > minVol && guess < maxVol,
+                   "guess (" << guess << ") out of volatility range");
+    }
+
+    void VanillaImpliedVolatilities_2::calculate() {
+
+        boost::shared_ptr<SimpleQuote> volatility(new SimpleQuote(guess_));
+        Handle<BlackVolTermStructure> flatVol(
+            boost::shared_ptr<BlackVolTermStructure>(
+                new BlackConstantVol(0, NullCalendar(),
+                                     Handle<Quote>(volatility),
+                                     riskFreeRate_->dayCounter())));
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process(
+                         new GeneralizedBlackScholesProcess(
+                                      underlying_, dividendYield_,
+                                      riskFreeRate_, flatVol));
+        boost::shared_ptr<PricingEngine> engine = engineFactory_(process);
+
+        // the vega, if any, is read from the results of the engine
+        const OneAssetOption::results* results =
+            dynamic_cast<const OneAssetOption::results*>(engine->getResults());
+        QL_REQUIRE(results != 0, "engine does not provide vanilla results");
+
+        Size m = payoffs_.size();
+        std::vector<Size> order(m);
+        std::iota(order.begin(), order.end(), Size(0));
+        std::sort(order.begin(), order.end(),
+                  [this](Size i, Size j) {
+                      return payoffs_[i]->strike() < payoffs_[j]->strike();
+                  });
+
+        volatilities_.assign(m, Null<Volatility>());
+        iterations_.assign(m, 0);
+        Volatility start = guess_;
+        for (Size i=0; i<m; ++i) {
+            Size o = order[i];
+            VanillaOption option(payoffs_[o], exercise_);
+            option.setPricingEngine(engine);
+
+            Volatility lower = minVol_, upper = maxVol_, vol = start;
+            for (Size k=0; k<maxIterations_; ++k) {
+                volatility->setValue(vol);
+                Real error = option.NPV() - prices_[o];
+                iterations_[o] = k+1;
+                if (std::fabs(error) <= accuracy_) {
+                    volatilities_[o] = vol;
+                    break;
+                }
+                // prices increase with volatility
+                if (error > 0.0)
+                    upper = vol;
+                else
+                    lower = vol;
+
+                // Newton step if the engine gives the vega and the
+                // step stays within the bracket, bisection otherwise
+                Volatility next = 0.5*(lower + upper);
+                Real vega = results->vega;
+                if (vega != Null<Real>() && vega > 0.0) {
+                    Volatility newton = vol - error/vega;
+                    if (newton > lower && newton < upper)
+                        next = newton;
+                }
+                vol = next;
+            }
+
+            // warm start for the next strike
+            if (volatilities_[o] != Null<Volatility>())
+                start = volatilities_[o];
+        }
+    }
+
+}
+
@@ -0,0 +1,87 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*! \file impliedvolatilities.hpp
+    \brief Implied volatilities of many vanilla options at one expiry
+*/
+
+#ifndef implied_volatilities_hpp
+#define implied_volatilities_hpp
+
+#include <ql/exercise.hpp>
+#include <ql/instruments/payoffs.hpp>
+#include <ql/pricingengine.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include <boost/function.hpp>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Implied volatilities for a batch of vanilla option quotes
+    /*! All the options must share the underlying and the exercise;
+        they can differ in strike and type.  A single process, whose
+        constant volatility is driven by a quote, and a single
+        engine are built for the whole batch; the engine is created
+        by the given factory, so that any of the deterministic
+        engines in this project can be used.  Monte Carlo engines
+        are not supported, since their prices are noisy and can't
+        be inverted to the given accuracy.  The engine still builds
+        its tree at each iteration, as the nodes and the branch
+        probabilities depend on the volatility.
+
+        Each volatility is bracketed between the volatilities known
+        to give prices below and above the target.  When the engine
+        provides the vega, as FlatBinomialVanillaEngine_2 does in
+        adjoint mode, the bracket is narrowed by Newton steps, each
+        taking a single rollback; otherwise, or when a Newton step
+        falls outside the bracket, by bisection.  Quotes are solved
+        in order of strike, each starting from the volatility of
+        the previous one, which usually leaves a couple of Newton
+        iterations per quote.
+
+        Quotes for which no volatility is found within the given
+        number of iterations are returned as Null<Volatility>().
+    */
+    class VanillaImpliedVolatilities_2 {
+      public:
+        typedef boost::function<boost::shared_ptr<PricingEngine>(
+                const boost::shared_ptr<GeneralizedBlackScholesProcess>&)>
+                                                              engine_factory;
+        VanillaImpliedVolatilities_2(
+             const Handle<Quote>& underlying,
+             const Handle<YieldTermStructure>& dividendYield,
+             const Handle<YieldTermStructure>& riskFreeRate,
+             const std::vector<boost::shared_ptr<PlainVanillaPayoff> >& payoffs,
+             const boost::shared_ptr<Exercise>& exercise,
+             const std::vector<Real>& prices,
+             const engine_factory& engineFactory,
+             Real accuracy = 1.0e-6,
+             Size maxIterations = 50,
+             Volatility guess = 0.20,
+             Volatility minVol = 1.0e-4,
+             Volatility maxVol = 4.0);
+        void calculate();
+        //! \name Results
+        //@{
+        const std::vector<Volatility>& impliedVolatilities() const {
+            return volatilities_;
+        }
+        const std::vector<Size>& iterations() const { return iterations_; }
+        //@}
+      private:
+        Handle<Quote> underlying_;
+        Handle<YieldTermStructure> dividendYield_, riskFreeRate_;
+        std::vector<boost::shared_ptr<PlainVanillaPayoff> > payoffs_;
+        boost::shared_ptr<Exercise> exercise_;
+        std::vector<Real> prices_;
+        engine_factory engineFactory_;
+        Real accuracy_;
+        Size maxIterations_;
+        Volatility guess_, minVol_, maxVol_;
+        std::vector<Volatility> volatilities_;
+        std::vector<Size> iterations_;
+    };
+
+}
+
+
+#endif
@@ -1,20 +1,111 @@
 
 #include "binomialtree.hpp"
 #include "binomialengine.hpp"
+#include "flatbinomialengine.hpp"
+#include "binomialportfolio.hpp"
+#include "impliedvolatilities.hpp"
+#include <ql/math/randomnumbers/mt19937uniformrng.hpp>
 #include <ql/methods/lattices/binomialtree.hpp>
+#include <ql/pricingengines/vanilla/analyticeuropeanengine.hpp>
 #include <ql/pricingengines/vanilla/binomialengine.hpp>
 #include <ql/instruments/vanillaoption.hpp>
 #include <ql/instruments/payoffs.hpp>
 #include <ql/exercise.hpp>
+#include <ql/quotes/simplequote.hpp>
+#include <ql/termstructures/yield/flatforward.hpp>
 #include <ql/termstructures/yield/zerocurve.hpp>
+#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
 #include <ql/termstructures/volatility/equityfx/blackvariancecurve.hpp>
 #include <ql/time/calendars/target.hpp>
 #include <ql/utilities/dataformatters.hpp>
+#include <algorithm>
 #include <iostream>
 #include <chrono>
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
 
 using namespace QuantLib;
 
+namespace {
+
+    // checks that BinomialVanillaEngine_2 reuses its tree correctly:
+    // after a change, the results must be the same as the ones of a
+    // fresh engine, to round-off if only the spot moved and the tree
+    // was rescaled, exactly if the tree was rebuilt
+    template <class T>
+    void checkTreeReuse(const std::string& name,
+                        const ext::shared_ptr<StrikedTypePayoff>& payoff,
+                        const ext::shared_ptr<Exercise>& exercise) {
+
+        Date today = Settings::instance().evaluationDate();
+        DayCounter dayCounter = Actual365Fixed();
+        ext::shared_ptr<SimpleQuote> spot(new SimpleQuote(36.0));
+        ext::shared_ptr<SimpleQuote> vol(new SimpleQuote(0.20));
+        Rate rate = 0.01;
+        RelinkableHandle<YieldTermStructure> riskFreeRate(
+            ext::make_shared<FlatForward>(today, rate, dayCounter));
+        Handle<YieldTermStructure> dividendYield(
+            ext::make_shared<FlatForward>(today, 0.0, dayCounter));
+        Handle<BlackVolTermStructure> volatility(
+            ext::make_shared<BlackConstantVol>(today, TARGET(),
+                                               Handle<Quote>(vol),
+                                               dayCounter));
+        ext::shared_ptr<GeneralizedBlackScholesProcess> process(
+            new GeneralizedBlackScholesProcess(Handle<Quote>(spot),
+                                               dividendYield, riskFreeRate,
+                                               volatility));
+
+        Size steps = 101;
+        VanillaOption option(payoff, exercise);
+        option.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                            new BinomialVanillaEngine_2<T>(process, steps)));
+        option.NPV();
+
+        struct Change {
+            std::string description;
+            Real spot, vol, rate;
+            bool rebuild;
+        };
+        Change changes[] = {
+            {"spot moved", 37.0, 0.20, 0.01, !T::rescalable},
+            {"volatility changed", 37.0, 0.25, 0.01, true},
+            {"rate changed", 37.0, 0.25, 0.02, true},
+            {"spot and rate changed", 38.0, 0.25, 0.03, true}
+        };
+        for (const Change& change : changes) {
+            spot->setValue(change.spot);
+            vol->setValue(change.vol);
+            if (change.rate != rate) {
+                rate = change.rate;
+                riskFreeRate.linkTo(ext::make_shared<FlatForward>(
+                                                today, rate, dayCounter));
+            }
+
+            VanillaOption fresh(payoff, exercise);
+            fresh.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                            new BinomialVanillaEngine_2<T>(process, steps)));
+
+            Real reused[4] = { option.NPV(), option.delta(),
+                               option.gamma(), option.theta() };
+            Real expected[4] = { fresh.NPV(), fresh.delta(),
+                                 fresh.gamma(), fresh.theta() };
+            const char* results[4] = { "NPV", "delta", "gamma", "theta" };
+            Real tolerance = change.rebuild ? 0.0 : 1.0e-12;
+            for (Size i=0; i<4; ++i) {
+                Real difference = std::fabs(reused[i] - expected[i]);
+                QL_REQUIRE(difference <= tolerance*std::fabs(expected[i]),
+                           name << ", " << change.description << ": "
+                           << results[i] << " " << reused[i]
+                           << " instead of " << expected[i]);
+            }
+        }
+        std::cout << name << ": tree reuse checked" << std::endl;
+    }
+
+}
+
 int main() {
 
     try {
@@ -65,6 +156,459 @@ int main() {
         std::cout << "NPV: " << NPV << std::endl;
         std::cout << "Elapsed time: " << us / 1000000 << " s" << std::endl;
 
+        ext::shared_ptr<PricingEngine> flatEngine(
+                new FlatBinomialVanillaEngine_2<JarrowRudd_2>(bsmProcess,timeSteps));
+        americanOption.setPricingEngine(flatEngine);
+
+        startTime = std::chrono::steady_clock::now();
+
+        NPV = americanOption.NPV();
+
+        endTime = std::chrono::steady_clock::now();
+
+        us = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+
+        std::cout << "Flat-array engine" << std::endl;
+        std::cout << "NPV: " << NPV << std::endl;
+        std::cout << "Elapsed time: " << us / 1000000 << " s" << std::endl;
+
+        ext::shared_ptr<PricingEngine> threeNodesEngine(
+                new BinomialVanillaEngine_2<ThreeNodesBinomialTree_2<JarrowRudd_2> >(
+                                                        bsmProcess,timeSteps));
+        americanOption.setPricingEngine(threeNodesEngine);
+
+        startTime = std::chrono::steady_clock::now();
+
+        NPV = americanOption.NPV();
+        Real delta = americanOption.delta();
+        Real gamma = americanOption.gamma();
+        Real theta = americanOption.theta();
+
+        endTime = std::chrono::steady_clock::now();
+
+        us = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+
+        std::cout << "Three nodes at t=0" << std::endl;
+        std::cout << "NPV: " << NPV << std::endl;
+        std::cout << "Delta: " << delta << std::endl;
+        std::cout << "Gamma: " << gamma << std::endl;
+        std::cout << "Theta: " << theta << std::endl;
+        std::cout << "Elapsed time: " << us / 1000000 << " s" << std::endl;
+
+        // a portfolio rolled back on a single tree must agree with
+        // the same options priced one by one
+        std::vector<Real> strikes = {32.0, 36.0, 40.0, 44.0, 48.0};
+        std::vector<ext::shared_ptr<PlainVanillaPayoff> > payoffs;
+        for (Real k : strikes)
+            payoffs.push_back(ext::make_shared<PlainVanillaPayoff>(type, k));
+
+        // two steps is the smallest tree allowed; the rollback then
+        // starts at the step from which gamma is read
+        for (Size steps : {timeSteps, Size(2)}) {
+            BinomialVanillaPortfolio_2<JarrowRudd_2> portfolio(
+                         bsmProcess, payoffs, americanExercise, steps);
+
+            startTime = std::chrono::steady_clock::now();
+
+            portfolio.calculate();
+
+            endTime = std::chrono::steady_clock::now();
+
+            us = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+
+            std::cout << "Portfolio of " << payoffs.size() << " options, "
+                      << steps << " steps" << std::endl;
+            std::cout << "Elapsed time: " << us / 1000000 << " s" << std::endl;
+
+            for (Size j=0; j<payoffs.size(); ++j) {
+                VanillaOption option(payoffs[j], americanExercise);
+                option.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                    new BinomialVanillaEngine_2<JarrowRudd_2>(bsmProcess,
+                                                              steps)));
+                std::cout << "Strike " << strikes[j] << ": "
+                          << portfolio.NPV()[j] << " vs " << option.NPV()
+                          << std::endl;
+                QL_REQUIRE(std::fabs(portfolio.NPV()[j] - option.NPV()) < 1.0e-8,
+                           "portfolio and single-option prices for strike "
+                           << strikes[j] << " differ: " << portfolio.NPV()[j]
+                           << " vs " << option.NPV());
+                QL_REQUIRE(std::fabs(portfolio.delta()[j] - option.delta()) < 1.0e-8,
+                           "portfolio and single-option deltas for strike "
+                           << strikes[j] << " differ: " << portfolio.delta()[j]
+                           << " vs " << option.delta());
+                QL_REQUIRE(std::fabs(portfolio.gamma()[j] - option.gamma()) < 1.0e-8,
+                           "portfolio and single-option gammas for strike "
+                           << strikes[j] << " differ: " << portfolio.gamma()[j]
+                           << " vs " << option.gamma());
+            }
+        }
+
+        // Black-Scholes smoothing, alone (BBS) and with Richardson
+        // extrapolation (BBSR): European prices must converge to the
+        // analytic one and American prices to a fine-tree reference.
+        // At 400 steps, BBS is within about 1e-4 and BBSR within
+        // about 1e-6; the reference itself is within about 1e-5.
+        typedef FlatBinomialVanillaEngine_2<JarrowRudd_2> FlatEngine;
+        ext::shared_ptr<Exercise> europeanExercise(
+                                         new EuropeanExercise(maturity));
+        VanillaOption europeanOption(payoff, europeanExercise);
+        europeanOption.setPricingEngine(
+                       ext::make_shared<AnalyticEuropeanEngine>(bsmProcess));
+        Real analyticNPV = europeanOption.NPV();
+
+        Size referenceSteps = 20000;
+        americanOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                               new FlatEngine(bsmProcess, referenceSteps)));
+        Real referenceNPV = americanOption.NPV();
+
+        // the reference tree is large enough for the tiled rollback,
+        // whose results must be bit-identical to the serial ones
+        {
+            Real serial[3] = { referenceNPV, americanOption.delta(),
+                               americanOption.gamma() };
+            std::vector<Real> serialBoundary =
+                americanOption.result<std::vector<Real> >("exerciseBoundary");
+            americanOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                            new FlatEngine(bsmProcess, referenceSteps, 4)));
+
+            startTime = std::chrono::steady_clock::now();
+
+            Real parallel[3] = { americanOption.NPV(), americanOption.delta(),
+                                 americanOption.gamma() };
+
+            endTime = std::chrono::steady_clock::now();
+
+            us = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+
+            std::cout << referenceSteps << " steps, 4 threads" << std::endl;
+            std::cout << "NPV: " << parallel[0] << std::endl;
+            std::cout << "Elapsed time: " << us / 1000000 << " s" << std::endl;
+
+            const char* results[3] = { "NPV", "delta", "gamma" };
+            for (Size i=0; i<3; ++i)
+                QL_REQUIRE(parallel[i] == serial[i],
+                           "multi-threaded " << results[i] << " ("
+                           << parallel[i] << ") differs from the "
+                           "single-threaded one (" << serial[i] << ")");
+            QL_REQUIRE(americanOption.result<std::vector<Real> >(
+                                      "exerciseBoundary") == serialBoundary,
+                       "multi-threaded exercise boundary differs from "
+                       "the single-threaded one");
+        }
+
+        Size smoothingSteps = 400;
+        for (bool american : {false, true}) {
+            VanillaOption& option = american ? americanOption : europeanOption;
+            Real target = american ? referenceNPV : analyticNPV;
+            Real tolerances[2] = { 2.0e-4, american ? 3.0e-5 : 1.0e-5 };
+            FlatEngine::Extrapolation extrapolations[2] = {
+                FlatEngine::NoExtrapolation, FlatEngine::Richardson
+            };
+            for (Size e=0; e<2; ++e) {
+                option.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                    new FlatEngine(bsmProcess, smoothingSteps, 1,
+                                   extrapolations[e], true)));
+                Real error = std::fabs(option.NPV() - target);
+                std::cout << (american ? "American" : "European")
+                          << (e == 0 ? " BBS: " : " BBSR: ")
+                          << option.NPV() << " vs " << target << std::endl;
+                QL_REQUIRE(error < tolerances[e],
+                           (e == 0 ? "BBS" : "BBSR") << " error "
+                           << error << " exceeds " << tolerances[e]);
+            }
+        }
+
+        // Greeks at t=0 from a tree with three nodes there, against
+        // the analytic European ones; at 1000 steps, the errors are
+        // about 2e-4 for delta and 3e-4 (relative) for gamma, and
+        // below 1e-4 (relative) for theta
+        europeanOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+            new BinomialVanillaEngine_2<
+                        ThreeNodesBinomialTree_2<JarrowRudd_2> >(bsmProcess,
+                                                                 1000)));
+        Real threeNodeGreeks[3] = { europeanOption.delta(),
+                                    europeanOption.gamma(),
+                                    europeanOption.theta() };
+        europeanOption.setPricingEngine(
+                       ext::make_shared<AnalyticEuropeanEngine>(bsmProcess));
+        Real analyticGreeks[3] = { europeanOption.delta(),
+                                   europeanOption.gamma(),
+                                   europeanOption.theta() };
+        const char* greekNames[3] = { "delta", "gamma", "theta" };
+        Real greekTolerances[3] = {
+            1.0e-3, 1.0e-3*std::fabs(analyticGreeks[1]),
+            1.0e-3*std::fabs(analyticGreeks[2])
+        };
+        for (Size i=0; i<3; ++i) {
+            std::cout << "Three nodes at t=0, " << greekNames[i] << ": "
+                      << threeNodeGreeks[i] << " (analytic: "
+                      << analyticGreeks[i] << ")" << std::endl;
+            QL_REQUIRE(std::fabs(threeNodeGreeks[i] - analyticGreeks[i])
+                       < greekTolerances[i],
+                       "three-node " << greekNames[i] << " ("
+                       << threeNodeGreeks[i] << ") too far from the "
+                       "analytic one (" << analyticGreeks[i] << ")");
+        }
+
+        // with three steps, the smoothed rollback starts at the step
+        // from which gamma is read
+        europeanOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+            new FlatEngine(bsmProcess, 3, 1, FlatEngine::NoExtrapolation,
+                           true)));
+        QL_REQUIRE(europeanOption.gamma() > 0.0,
+                   "non-positive gamma (" << europeanOption.gamma()
+                   << ") with three smoothed steps");
+        QL_REQUIRE(europeanOption.delta() > -1.0 &&
+                   europeanOption.delta() < 0.0,
+                   "put delta (" << europeanOption.delta()
+                   << ") out of range with three smoothed steps");
+
+        // two-tree averaging must reduce the odd-even oscillation of
+        // a Cox-Ross-Rubinstein tree: over a range of step counts, the
+        // worst error of the averaged American prices against the
+        // reference is about a third of the one of the plain prices
+        typedef FlatBinomialVanillaEngine_2<CoxRossRubinstein_2> CRREngine;
+        Real plainError = 0.0, averagedError = 0.0;
+        for (Size steps=100; steps<=110; ++steps) {
+            americanOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                                       new CRREngine(bsmProcess, steps)));
+            Real plainNPV = americanOption.NPV();
+            americanOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                new CRREngine(bsmProcess, steps, 1,
+                              CRREngine::TwoTreeAverage)));
+            Real averagedNPV = americanOption.NPV();
+            // without extrapolation, the price is the one of the
+            // coarser tree
+            QL_REQUIRE(americanOption.result<Real>("coarseValue") == plainNPV,
+                       "price changed without extrapolation: " << plainNPV
+                       << " vs " << americanOption.result<Real>("coarseValue"));
+            plainError = std::max(plainError,
+                                  std::fabs(plainNPV - referenceNPV));
+            averagedError = std::max(averagedError,
+                                     std::fabs(averagedNPV - referenceNPV));
+        }
+        std::cout << "Worst error, plain: " << plainError
+                  << ", two-tree average: " << averagedError << std::endl;
+        QL_REQUIRE(averagedError < 0.5*plainError,
+                   "two-tree averaging doesn't reduce the error: "
+                   << averagedError << " vs " << plainError);
+
+        // Richardson extrapolation of smoothed prices must be closer
+        // to the reference than the smoothed price alone
+        Real extrapolationErrors[2];
+        FlatEngine::Extrapolation extrapolations[2] = {
+            FlatEngine::NoExtrapolation, FlatEngine::Richardson
+        };
+        for (Size e=0; e<2; ++e) {
+            americanOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                new FlatEngine(bsmProcess, smoothingSteps, 1,
+                               extrapolations[e], true)));
+            extrapolationErrors[e] =
+                std::fabs(americanOption.NPV() - referenceNPV);
+        }
+        QL_REQUIRE(extrapolationErrors[1] < extrapolationErrors[0],
+                   "Richardson extrapolation doesn't reduce the error: "
+                   << extrapolationErrors[1] << " vs "
+                   << extrapolationErrors[0]);
+
+        // reuse of the tree across calculations, with rescaling for
+        // the trees that allow it and full rebuilds for the others
+        checkTreeReuse<JarrowRudd_2>("Jarrow-Rudd", payoff, americanExercise);
+        checkTreeReuse<CoxRossRubinstein_2>("Cox-Ross-Rubinstein", payoff,
+                                            americanExercise);
+        checkTreeReuse<ThreeNodesBinomialTree_2<JarrowRudd_2> >(
+                      "Jarrow-Rudd, three nodes", payoff, americanExercise);
+        checkTreeReuse<LeisenReimer_2>("Leisen-Reimer", payoff,
+                                       americanExercise);
+        checkTreeReuse<Joshi4_2>("Joshi", payoff, americanExercise);
+
+        // adjoint Greeks against central differences of the tree
+        // price; both are derivatives of the same piecewise smooth
+        // function of the inputs, so they agree closely
+        ext::shared_ptr<SimpleQuote> spotQuote(new SimpleQuote(underlying));
+        ext::shared_ptr<SimpleQuote> volQuote(new SimpleQuote(0.20));
+        ext::shared_ptr<SimpleQuote> rateQuote(new SimpleQuote(0.01));
+        ext::shared_ptr<SimpleQuote> dividendQuote(new SimpleQuote(0.02));
+        ext::shared_ptr<GeneralizedBlackScholesProcess> quotedProcess(
+            new GeneralizedBlackScholesProcess(
+                Handle<Quote>(spotQuote),
+                Handle<YieldTermStructure>(ext::make_shared<FlatForward>(
+                    today, Handle<Quote>(dividendQuote), dayCounter)),
+                Handle<YieldTermStructure>(ext::make_shared<FlatForward>(
+                    today, Handle<Quote>(rateQuote), dayCounter)),
+                Handle<BlackVolTermStructure>(
+                    ext::make_shared<BlackConstantVol>(
+                        today, calendar, Handle<Quote>(volQuote),
+                        dayCounter))));
+        Size adjointSteps = 500;
+        VanillaOption adjointOption(payoff, americanExercise);
+        adjointOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+            new FlatEngine(quotedProcess, adjointSteps, 1,
+                           FlatEngine::NoExtrapolation, false, true)));
+        VanillaOption bumpedOption(payoff, americanExercise);
+        bumpedOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                               new FlatEngine(quotedProcess, adjointSteps)));
+        QL_REQUIRE(adjointOption.NPV() == bumpedOption.NPV(),
+                   "adjoint mode changed the price: " << adjointOption.NPV()
+                   << " vs " << bumpedOption.NPV());
+
+        struct Sensitivity {
+            std::string name;
+            ext::shared_ptr<SimpleQuote> quote;
+            Real bump, adjoint;
+        };
+        Sensitivity sensitivities[] = {
+            {"delta", spotQuote, 1.0e-4*underlying, adjointOption.delta()},
+            {"vega", volQuote, 1.0e-5, adjointOption.vega()},
+            {"rho", rateQuote, 1.0e-5, adjointOption.rho()},
+            {"dividend rho", dividendQuote, 1.0e-5,
+             adjointOption.dividendRho()}
+        };
+        for (const Sensitivity& sensitivity : sensitivities) {
+            Real x = sensitivity.quote->value();
+            sensitivity.quote->setValue(x + sensitivity.bump);
+            Real up = bumpedOption.NPV();
+            sensitivity.quote->setValue(x - sensitivity.bump);
+            Real down = bumpedOption.NPV();
+            sensitivity.quote->setValue(x);
+            Real centralDifference = (up - down)/(2.0*sensitivity.bump);
+            std::cout << "Adjoint " << sensitivity.name << ": "
+                      << sensitivity.adjoint << " (central difference: "
+                      << centralDifference << ")" << std::endl;
+            QL_REQUIRE(std::fabs(sensitivity.adjoint - centralDifference)
+                       <= 1.0e-4*std::fabs(centralDifference),
+                       "adjoint " << sensitivity.name << " ("
+                       << sensitivity.adjoint << ") differs from the "
+                       "central difference (" << centralDifference << ")");
+        }
+
+        // implied volatilities: prices computed at known volatilities
+        // must be inverted back to them, with Newton steps when the
+        // engine provides the vega (adjoint mode) and with bisection
+        // otherwise.  Far in the money, the price doesn't depend on
+        // the volatility, so the strikes are kept where the vega is
+        // above 1.  The last two prices, below the intrinsic value
+        // and above the price at the largest volatility, can't be
+        // inverted and must be returned as null.
+        Handle<YieldTermStructure> noDividends(
+                   ext::make_shared<FlatForward>(today, 0.0, dayCounter));
+        std::vector<Real> quotedStrikes = {30.0, 33.0, 36.0, 38.0, 40.0};
+        std::vector<Volatility> knownVols = {0.26, 0.23, 0.21, 0.20, 0.19};
+        std::vector<ext::shared_ptr<PlainVanillaPayoff> > quotedPayoffs;
+        std::vector<Real> quotedPrices;
+        Size solverSteps = 200;
+        for (Size j=0; j<quotedStrikes.size(); ++j) {
+            quotedPayoffs.push_back(
+                   ext::make_shared<PlainVanillaPayoff>(type, quotedStrikes[j]));
+            ext::shared_ptr<GeneralizedBlackScholesProcess> knownProcess(
+                new GeneralizedBlackScholesProcess(
+                    underlyingH, noDividends, riskFreeRate,
+                    Handle<BlackVolTermStructure>(
+                        ext::make_shared<BlackConstantVol>(
+                            today, calendar, knownVols[j], dayCounter))));
+            VanillaOption option(quotedPayoffs[j], americanExercise);
+            option.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                                new FlatEngine(knownProcess, solverSteps)));
+            quotedPrices.push_back(option.NPV());
+        }
+        quotedPayoffs.push_back(ext::make_shared<PlainVanillaPayoff>(type, 44.0));
+        quotedPrices.push_back(7.0);
+        quotedPayoffs.push_back(ext::make_shared<PlainVanillaPayoff>(type, 48.0));
+        quotedPrices.push_back(100.0);
+
+        Real accuracy = 1.0e-6;
+        Size solverIterations[2];
+        for (bool adjoint : {true, false}) {
+            VanillaImpliedVolatilities_2 solver(
+                underlyingH, noDividends, riskFreeRate, quotedPayoffs,
+                americanExercise, quotedPrices,
+                [=](const ext::shared_ptr<GeneralizedBlackScholesProcess>& p) {
+                    return ext::shared_ptr<PricingEngine>(
+                        new FlatEngine(p, solverSteps, 1,
+                                       FlatEngine::NoExtrapolation, false,
+                                       adjoint));
+                },
+                accuracy);
+
+            startTime = std::chrono::steady_clock::now();
+
+            solver.calculate();
+
+            endTime = std::chrono::steady_clock::now();
+
+            us = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+
+            const std::vector<Volatility>& vols = solver.impliedVolatilities();
+            solverIterations[adjoint] = 0;
+            for (Size j=0; j<knownVols.size(); ++j) {
+                solverIterations[adjoint] += solver.iterations()[j];
+                // the price is within the accuracy, hence the
+                // volatility within accuracy/vega
+                QL_REQUIRE(vols[j] != Null<Volatility>() &&
+                           std::fabs(vols[j] - knownVols[j]) < accuracy,
+                           (adjoint ? "Newton" : "bisection")
+                           << ": volatility " << knownVols[j]
+                           << " recovered as " << vols[j]);
+            }
+            for (Size j=knownVols.size(); j<quotedPrices.size(); ++j)
+                QL_REQUIRE(vols[j] == Null<Volatility>(),
+                           (adjoint ? "Newton" : "bisection")
+                           << ": volatility " << vols[j]
+                           << " returned for price " << quotedPrices[j]);
+
+            std::cout << "Implied volatilities, "
+                      << (adjoint ? "Newton" : "bisection") << ": "
+                      << solverIterations[adjoint] << " iterations"
+                      << std::endl;
+            std::cout << "Elapsed time: " << us / 1000000 << " s" << std::endl;
+        }
+        QL_REQUIRE(solverIterations[true] < solverIterations[false],
+                   "Newton steps took more iterations ("
+                   << solverIterations[true] << ") than bisection ("
+                   << solverIterations[false] << ")");
+
+        // the vectorized rollback kernels supported by the CPU must
+        // give the same results as the scalar one, bit by bit; the
+        // size is chosen so that the scalar tails are used as well
+        {
+            std::vector<std::pair<std::string, detail::binomial_rollback_kernel> >
+                kernels;
+            #if defined(BINOMIAL_ROLLBACK_X86_DISPATCH)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                kernels.push_back(std::make_pair(
+                    std::string("AVX2"), &detail::binomialRollbackAvx2));
+            if (__builtin_cpu_supports("avx512f"))
+                kernels.push_back(std::make_pair(
+                    std::string("AVX-512"), &detail::binomialRollbackAvx512));
+            #endif
+            Size n = 1003;
+            MersenneTwisterUniformRng rng(42);
+            std::vector<Real> input(n+1), exercise(n);
+            for (Size j=0; j<=n; ++j)
+                input[j] = 10.0*rng.nextReal();
+            for (Size j=0; j<n; ++j)
+                exercise[j] = 10.0*rng.nextReal();
+            for (bool withExercise : {false, true}) {
+                const Real* e = withExercise ? &exercise[0] : 0;
+                std::vector<Real> expected(input);
+                detail::binomialRollbackScalar(&expected[0], e, n,
+                                               0.51, 0.49, 0.9995);
+                for (Size i=0; i<kernels.size(); ++i) {
+                    std::vector<Real> values(input);
+                    kernels[i].second(&values[0], e, n, 0.51, 0.49, 0.9995);
+                    QL_REQUIRE(values == expected,
+                               kernels[i].first << " rollback kernel "
+                               "differs from the scalar one"
+                               << (withExercise ? " with exercise" : ""));
+                }
+            }
+            std::cout << "Rollback kernels checked: scalar";
+            for (Size i=0; i<kernels.size(); ++i)
+                std::cout << ", " << kernels[i].first;
+            std::cout << std::endl;
+        }
+
         return 0;
 
     } catch (std::exception& e) {
@@ -1,16 +1,22 @@
 
 #include "binomialengine.hpp"
+#include "../project3/flatbinomialengine.hpp"
 #include <ql/pricingengines/vanilla/binomialengine.hpp>
 #include <ql/methods/lattices/binomialtree.hpp>
+#include <ql/cashflows/dividend.hpp>
 #include <ql/instruments/vanillaoption.hpp>
 #include <ql/instruments/payoffs.hpp>
 #include <ql/exercise.hpp>
+#include <ql/termstructures/yield/flatforward.hpp>
 #include <ql/termstructures/yield/zerocurve.hpp>
+#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
 #include <ql/termstructures/volatility/equityfx/blackvariancecurve.hpp>
 #include <ql/time/calendars/target.hpp>
 #include <ql/utilities/dataformatters.hpp>
 #include <iostream>
 #include <chrono>
+#include <cmath>
+#include <vector>
 
 using namespace QuantLib;
 
@@ -64,6 +70,145 @@ int main() {
         std::cout << "NPV: " << NPV << std::endl;
         std::cout << "Elapsed time: " << us / 1000000 << " s" << std::endl;
 
+        ext::shared_ptr<PricingEngine> flatEngine(
+                new FlatBinomialVanillaEngine_2<JarrowRudd>(bsmProcess,timeSteps));
+        americanOption.setPricingEngine(flatEngine);
+
+        startTime = std::chrono::steady_clock::now();
+
+        NPV = americanOption.NPV();
+
+        endTime = std::chrono::steady_clock::now();
+
+        us = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+
+        std::cout << "Flat-array engine" << std::endl;
+        std::cout << "NPV: " << NPV << std::endl;
+        std::cout << "Elapsed time: " << us / 1000000 << " s" << std::endl;
+
+        // Bermudan exercise against the QuantLib engine; with one
+        // step per day, the exercise dates fall on the time grid
+        // and both engines exercise at the same steps
+        std::vector<Date> bermudanDates = {
+            today + 1*Months, today + 2*Months, maturity
+        };
+        ext::shared_ptr<Exercise> bermudanExercise(
+                                    new BermudanExercise(bermudanDates));
+        VanillaOption bermudanOption(payoff, bermudanExercise);
+        Size dailySteps = maturity - today;
+
+        bermudanOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+            new BinomialVanillaEngine<JarrowRudd>(bsmProcess, dailySteps)));
+        Real qlNPV = bermudanOption.NPV();
+        bermudanOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+            new FlatBinomialVanillaEngine_2<JarrowRudd>(bsmProcess,
+                                                        dailySteps)));
+        Real flatNPV = bermudanOption.NPV();
+
+        std::cout << "Bermudan option" << std::endl;
+        std::cout << "NPV: " << flatNPV << " (QuantLib engine: " << qlNPV
+                  << ")" << std::endl;
+        QL_REQUIRE(std::fabs(flatNPV - qlNPV) < 1.0e-8,
+                   "Bermudan prices differ: " << flatNPV << " vs " << qlNPV);
+
+        // cash dividends with daily steps: a dividend paid on an
+        // exercise date must be collected by exercising on that date,
+        // whichever side of the step its time falls by rounding, so
+        // that the price is almost the same as with the dividend paid
+        // the day after (the difference is the discounting of the
+        // dividend over a day, about 1e-4 here).  A dividend paid at
+        // maturity isn't received by the option and must not change
+        // its price, with or without smoothing.
+        ext::shared_ptr<StrikedTypePayoff> callPayoff(
+                                  new PlainVanillaPayoff(Option::Call, 30.0));
+        Real dividend = 2.0;
+        for (Size day=1; day+1<dailySteps; ++day) {
+            Date paymentDate = today + Integer(day);
+            VanillaOption dividendOption(callPayoff,
+                ext::shared_ptr<Exercise>(new BermudanExercise(
+                    std::vector<Date>{paymentDate, maturity})));
+            Real dividendNPVs[2];
+            for (Size shift=0; shift<2; ++shift) {
+                DividendSchedule dividends(1,
+                    ext::make_shared<FixedDividend>(
+                        dividend, paymentDate + Integer(shift)));
+                dividendOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                    new FlatBinomialVanillaEngine_2<JarrowRudd>(
+                        bsmProcess, dailySteps, 1,
+                        FlatBinomialVanillaEngine_2<JarrowRudd>::NoExtrapolation,
+                        false, false, dividends)));
+                dividendNPVs[shift] = dividendOption.NPV();
+            }
+            QL_REQUIRE(std::fabs(dividendNPVs[0] - dividendNPVs[1]) < 1.0e-3,
+                       "dividend paid on " << paymentDate << " not collected: "
+                       << dividendNPVs[0] << " vs " << dividendNPVs[1]
+                       << " with the dividend paid the day after");
+        }
+
+        VanillaOption callOption(callPayoff, americanExercise);
+        for (bool smoothing : {false, true}) {
+            Real maturityNPVs[2];
+            for (Size withDividend=0; withDividend<2; ++withDividend) {
+                DividendSchedule dividends;
+                if (withDividend)
+                    dividends.push_back(
+                        ext::make_shared<FixedDividend>(dividend, maturity));
+                callOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                    new FlatBinomialVanillaEngine_2<JarrowRudd>(
+                        bsmProcess, dailySteps, 1,
+                        FlatBinomialVanillaEngine_2<JarrowRudd>::NoExtrapolation,
+                        smoothing, false, dividends)));
+                maturityNPVs[withDividend] = callOption.NPV();
+            }
+            QL_REQUIRE(maturityNPVs[1] == maturityNPVs[0],
+                       "dividend paid at maturity changed the price"
+                       << (smoothing ? " with smoothing" : "") << ": "
+                       << maturityNPVs[1] << " vs " << maturityNPVs[0]);
+        }
+        std::cout << "Dividends checked" << std::endl;
+
+        // truncated rollback on a long-dated, deep in-the-money
+        // American put; the nodes far from the strike are not rolled
+        // back, but the price must not change
+        Date longMaturity = today + 5*Years;
+        ext::shared_ptr<BlackScholesProcess> flatProcess(
+            new BlackScholesProcess(
+                Handle<Quote>(ext::make_shared<SimpleQuote>(25.0)),
+                Handle<YieldTermStructure>(
+                    ext::make_shared<FlatForward>(today, 0.05, dayCounter)),
+                Handle<BlackVolTermStructure>(
+                    ext::make_shared<BlackConstantVol>(today, calendar, 0.30,
+                                                       dayCounter))));
+        VanillaOption longOption(payoff, ext::shared_ptr<Exercise>(
+                                   new AmericanExercise(today, longMaturity)));
+        Size longSteps = 5000;
+
+        Real truncatedNPVs[2];
+        Real truncations[2] = { 0.0, 6.0 };
+        for (Size i=0; i<2; ++i) {
+            longOption.setPricingEngine(ext::shared_ptr<PricingEngine>(
+                new FlatBinomialVanillaEngine_2<JarrowRudd>(
+                    flatProcess, longSteps, 1,
+                    FlatBinomialVanillaEngine_2<JarrowRudd>::NoExtrapolation,
+                    false, false, DividendSchedule(), truncations[i])));
+
+            startTime = std::chrono::steady_clock::now();
+
+            truncatedNPVs[i] = longOption.NPV();
+
+            endTime = std::chrono::steady_clock::now();
+
+            us = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+
+            std::cout << "Long-dated put, truncation " << truncations[i]
+                      << std::endl;
+            std::cout << "NPV: " << truncatedNPVs[i] << std::endl;
+            std::cout << "Elapsed time: " << us / 1000000 << " s" << std::endl;
+        }
+        QL_REQUIRE(std::fabs(truncatedNPVs[1] - truncatedNPVs[0]) < 1.0e-6,
+                   "truncated rollback changed the price: "
+                   << truncatedNPVs[1] << " vs " << truncatedNPVs[0]);
+
         return 0;
 
     } catch (std::exception& e) {